@@ -0,0 +1,38 @@
+#ifndef ADDRESS_WIDTH_H
+#define ADDRESS_WIDTH_H
+
+#include <inttypes.h>
+#include <stdint.h>
+
+// Width of the simulated addresses, fixed at compile time so the hot path never branches on it.
+// The default build keeps 32-bit addresses and tags; -DSIM_ADDRESS_64 (make sim64) widens trace
+// addresses, tags, block addresses and the stream buffers to 64 bits for traces of 48-bit and
+// larger virtual addresses. A 32-bit build rejects a trace address that does not fit instead of
+// truncating it.
+
+#ifdef SIM_ADDRESS_64
+typedef uint64_t CacheAddress;
+typedef int64_t CacheAddressDelta;
+#define MaxAddressBitSize 64
+#define CacheAddressFormat "%" PRIx64
+#else
+typedef uint32_t CacheAddress;
+typedef int32_t CacheAddressDelta;
+#define MaxAddressBitSize 32
+#define CacheAddressFormat "%" PRIx32
+#endif
+
+#define CacheAddressMax ((CacheAddress)-1)
+
+// 32 bits of an address for hashing: the high half folded into the low one, so addresses below
+// 4 GB hash the same in either build
+static inline uint32_t CacheAddressFold(CacheAddress Address)
+{
+#ifdef SIM_ADDRESS_64
+   return (uint32_t)(Address ^ (Address >> 32));
+#else
+   return Address;
+#endif
+}
+
+#endif
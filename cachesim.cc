@@ -0,0 +1,103 @@
+#include "cachesim.h"
+#include "hierarchy.h"
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+#define CacheSimulatorBatchSize 4096
+
+struct cachesim_hierarchy
+{
+   unique_ptr<CacheHierarchy> Hierarchy;
+};
+
+extern "C" cachesim_hierarchy *cachesim_create(uint32_t block_size, const cachesim_level *levels, uint32_t level_count)
+{
+   if ((levels == NULL) || (level_count == 0) || (level_count > CacheLevelsMax))
+      return NULL;
+   vector<LevelConfiguration> Levels;
+   for (uint32_t Level = 0; Level < level_count; Level++)
+   {
+      LevelConfiguration Configuration = {"L" + to_string(Level + 1), levels[Level].size, levels[Level].assoc, levels[Level].pref_n, levels[Level].pref_m, LruPolicy};
+      if ((levels[Level].policy != NULL) && !FindReplacementPolicy(levels[Level].policy, Configuration.Policy))
+         return NULL;
+      if (levels[Level].prefetcher != NULL)
+         Configuration.Prefetcher = levels[Level].prefetcher;
+      Levels.push_back(Configuration);
+   }
+   string Error;
+   SimulatorConfiguration Configuration = LevelsConfiguration(block_size, Levels, Error);
+   if (!Error.empty())
+      return NULL;
+
+   cachesim_hierarchy *Simulator = new cachesim_hierarchy;
+   Simulator->Hierarchy.reset(new CacheHierarchy(Configuration));
+   return Simulator;
+}
+
+extern "C" void cachesim_destroy(cachesim_hierarchy *hierarchy)
+{
+   delete hierarchy;
+}
+
+extern "C" int cachesim_access(cachesim_hierarchy *hierarchy, uint64_t address, uint8_t operation)
+{
+   if (address > CacheAddressMax)
+      return -1;
+   return hierarchy->Hierarchy->Access((CacheAddress)address, operation & CACHESIM_WRITE);
+}
+
+extern "C" size_t cachesim_access_batch(cachesim_hierarchy *hierarchy, const uint64_t *addresses, const uint8_t *operations, size_t count)
+{
+   TraceRecord Records[CacheSimulatorBatchSize];
+   size_t Simulated = 0;
+   while (Simulated < count)
+   {
+      size_t RecordCount = 0;
+      while ((RecordCount < CacheSimulatorBatchSize) && (Simulated + RecordCount < count) && (addresses[Simulated + RecordCount] <= CacheAddressMax))
+      {
+         TraceRecord &Record = Records[RecordCount];
+         Record.Address = (CacheAddress)addresses[Simulated + RecordCount];
+         TraceSetOperation(Record, (operations != NULL) ? (operations[Simulated + RecordCount] & CACHESIM_WRITE) : 0);
+         RecordCount++;
+      }
+      if (RecordCount == 0)
+         break;
+      size_t RecordsSimulated = hierarchy->Hierarchy->Simulate(Records, RecordCount);
+      Simulated += RecordsSimulated;
+      if (RecordsSimulated < RecordCount)
+         break;
+   }
+   return Simulated;
+}
+
+extern "C" void cachesim_finish(cachesim_hierarchy *hierarchy)
+{
+   hierarchy->Hierarchy->Finish();
+}
+
+extern "C" uint32_t cachesim_level_count(const cachesim_hierarchy *hierarchy)
+{
+   return hierarchy->Hierarchy->LevelCount;
+}
+
+extern "C" int cachesim_level_counters(const cachesim_hierarchy *hierarchy, uint32_t level, cachesim_counters *counters)
+{
+   if (level >= hierarchy->Hierarchy->LevelCount)
+      return -1;
+   CacheStatistics Statistics = hierarchy->Hierarchy->LevelStatistics(level);
+   counters->reads = Statistics.ReadCount;
+   counters->read_misses = Statistics.ReadMissCount;
+   counters->prefetch_reads = Statistics.ReadPrefetchCount;
+   counters->prefetch_read_misses = Statistics.ReadMissPrefetchCount;
+   counters->writes = Statistics.WriteCount;
+   counters->write_misses = Statistics.WriteMissCount;
+   counters->writebacks = Statistics.WriteBackCount;
+   counters->prefetches = Statistics.PrefetchesCount;
+   counters->prefetch_hits = Statistics.PrefetchHitCount;
+   counters->useless_prefetches = Statistics.UselessPrefetchCount;
+   counters->memory_traffic = Statistics.MemoryTraffic;
+   counters->memory_writebacks = Statistics.MemoryWriteBackCount;
+   return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef CACHESIM_H
+#define CACHESIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* C interface of libcachesim, for callers that cannot use the C++ CacheHierarchy of hierarchy.h
+   directly (C programs, Python through ctypes or cffi). A hierarchy is created from its levels,
+   top first, and fed addresses straight from memory, one at a time or in batches. Its counters
+   can be read at any point. Addresses are taken as 64-bit values; a library built without
+   -DSIM_ADDRESS_64 rejects the ones that do not fit in 32 bits. cachesim_create returns NULL for
+   any configuration sim would reject; the library never prints or exits. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CACHESIM_WRITE 0x1 /* TraceOperationWrite */
+
+typedef struct cachesim_hierarchy cachesim_hierarchy;
+
+/* One cache level */
+typedef struct
+{
+   uint32_t size;
+   uint32_t assoc;
+   uint32_t pref_n;        /* stream buffers, 0 for none */
+   uint32_t pref_m;        /* blocks per stream buffer */
+   const char *policy;     /* lru, plru, srrip, brrip, drrip, fifo or random; NULL for lru */
+   const char *prefetcher; /* prefetcher engine as NAME[:DEGREE]; NULL for none */
+} cachesim_level;
+
+/* The counters of one level, as in the --format=json report */
+typedef struct
+{
+   uint64_t reads;
+   uint64_t read_misses;
+   uint64_t prefetch_reads;
+   uint64_t prefetch_read_misses;
+   uint64_t writes;
+   uint64_t write_misses;
+   uint64_t writebacks;
+   uint64_t prefetches;
+   uint64_t prefetch_hits;
+   uint64_t useless_prefetches;
+   uint64_t memory_traffic;
+   uint64_t memory_writebacks;
+} cachesim_counters;
+
+cachesim_hierarchy *cachesim_create(uint32_t block_size, const cachesim_level *levels, uint32_t level_count);
+void cachesim_destroy(cachesim_hierarchy *hierarchy);
+
+/* One access; operation is 0 for a read or CACHESIM_WRITE. Returns 1 on a top level demand
+   miss, 0 on a hit and -1 when the address does not fit. */
+int cachesim_access(cachesim_hierarchy *hierarchy, uint64_t address, uint8_t operation);
+
+/* count accesses in order; operations may be NULL for all reads. Returns the number simulated,
+   which is less than count only when an address does not fit. Faster than one cachesim_access
+   per address on large caches, as a batch prefetches the sets of upcoming accesses. */
+size_t cachesim_access_batch(cachesim_hierarchy *hierarchy, const uint64_t *addresses, const uint8_t *operations, size_t count);
+
+/* After the last access: settles the prefetcher counters */
+void cachesim_finish(cachesim_hierarchy *hierarchy);
+
+uint32_t cachesim_level_count(const cachesim_hierarchy *hierarchy);
+
+/* Returns 0, or -1 when level is not below cachesim_level_count */
+int cachesim_level_counters(const cachesim_hierarchy *hierarchy, uint32_t level, cachesim_counters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "trace_reader.h"
+
+// Checkpoint files: CheckpointMagic, uint32 version, uint32 level count, uint64 trace offset
+// (records consumed so far), then one section per cache level written by
+// CacheModule::SaveCheckpoint. Fields are host-endian and the set array of every level starts
+// on a CheckpointAlignment boundary, so a checkpoint is read straight out of a mapping.
+// Tags are CacheAddress wide, so 64-bit address builds use their own magic.
+
+#ifdef SIM_ADDRESS_64
+#define CheckpointMagic "CMHCKP64"
+#else
+#define CheckpointMagic "CMHCKPT\0"
+#endif
+#define CheckpointMagicSize 8
+#define CheckpointVersion 2
+#define CheckpointAlignment 64
+
+class CheckpointWriter
+{
+public:
+   vector<uint8_t> Buffer;
+
+   template <typename T>
+   void Put(const T &Value)
+   {
+      PutBytes(&Value, sizeof(Value));
+   }
+
+   void PutBytes(const void *Data, size_t Size)
+   {
+      Buffer.insert(Buffer.end(), (const uint8_t *)Data, (const uint8_t *)Data + Size);
+   }
+
+   void Align()
+   {
+      Buffer.resize((Buffer.size() + CheckpointAlignment - 1) & ~(size_t)(CheckpointAlignment - 1), 0);
+   }
+
+   bool Write(const char *CheckpointFileName)
+   {
+      FILE *CheckpointFilePointer = fopen(CheckpointFileName, "wb");
+      if (CheckpointFilePointer == (FILE *)NULL)
+         return false;
+      bool Success = fwrite(Buffer.data(), 1, Buffer.size(), CheckpointFilePointer) == Buffer.size();
+      return (fclose(CheckpointFilePointer) == 0) && Success;
+   }
+};
+
+class CheckpointReader
+{
+public:
+   shared_ptr<const TraceMapping> Mapping;
+   size_t Position = 0;
+
+   bool Open(const char *CheckpointFileName)
+   {
+      Mapping = TraceMapping::Map(CheckpointFileName);
+      Position = 0;
+      return Mapping != NULL;
+   }
+
+   template <typename T>
+   T Get()
+   {
+      T Value;
+      memcpy(&Value, GetBytes(sizeof(Value)), sizeof(Value));
+      return Value;
+   }
+
+   // Pointer to the next Size bytes of the mapping
+   const uint8_t *GetBytes(size_t Size)
+   {
+      if (Size > Mapping->Size - Position)
+      {
+         cout << "Error: Truncated checkpoint" << '\n';
+         exit(EXIT_FAILURE);
+      }
+      const uint8_t *Data = (const uint8_t *)Mapping->Data + Position;
+      Position += Size;
+      return Data;
+   }
+
+   void Align()
+   {
+      Position = min(Mapping->Size, (Position + CheckpointAlignment - 1) & ~(size_t)(CheckpointAlignment - 1));
+   }
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdint.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+// Multi-core simulation: every core gets a private copy of the top cache level (or a pair of
+// them, instruction and data, with the split) and all cores share the levels below it. A
+// full-map directory keeps the private caches coherent under MESI or MOESI, with the states
+// held in the CacheModule state bytes:
+//   M  CacheValidFlag | CacheDirtyFlag         E  CacheValidFlag
+//   O  CacheValidFlag | CacheDirtyFlag | CacheSharedFlag (MOESI only)
+//   S  CacheValidFlag | CacheSharedFlag        I  not cached
+// The directory holds one bit per core for each block some private cache holds, hence at most
+// TraceCoreMax cores. A read miss on a block another cache holds dirty is supplied by that cache;
+// under MESI the owner also writes the block back and keeps it in S, under MOESI it keeps the
+// block dirty in O. A write miss, or a write hit on S or O, invalidates every other copy.
+// Instruction caches only ever take fetches, so they never hold dirty blocks, but writes from
+// any core still invalidate them.
+
+#define CoherenceMesi 0
+#define CoherenceMoesi 1
+
+// Coherence counters of one private cache, next to the CacheModule ones
+struct CoherenceStatistics
+{
+   uint32_t Invalidations = 0;   // copies this cache lost to another cache's write
+   uint32_t CoherenceMisses = 0; // misses on blocks this cache last lost to an invalidation
+   uint32_t Upgrades = 0;        // write hits on S or O blocks, which invalidate the other copies
+   uint32_t Interventions = 0;   // misses of other caches this cache supplied a dirty block for
+
+   void Add(const CoherenceStatistics &Statistics)
+   {
+      Invalidations += Statistics.Invalidations;
+      CoherenceMisses += Statistics.CoherenceMisses;
+      Upgrades += Statistics.Upgrades;
+      Interventions += Statistics.Interventions;
+   }
+};
+
+struct PrivateCache
+{
+   CacheModule *Cache = NULL;
+   CoherenceStatistics Statistics;
+   unordered_set<CacheAddress> InvalidatedBlocks; // invalidated here and not missed on since
+};
+
+class CoherentCores
+{
+public:
+   uint32_t CoreCount;
+   bool SplitFlag;
+   uint32_t Protocol;
+   vector<PrivateCache> DataCaches;
+   vector<PrivateCache> InstructionCaches; // empty without the split
+   unordered_map<CacheAddress, uint64_t> Sharers; // block address -> cores holding it privately
+
+   // Core 0's data cache is TopLevel itself; the other private caches copy its geometry, policy
+   // and next level
+   CoherentCores(CacheModule &TopLevel, uint32_t InputCoreCount, bool InputSplitFlag, uint32_t InputProtocol, uint64_t ReplacementSeed)
+       : CoreCount(InputCoreCount), SplitFlag(InputSplitFlag), Protocol(InputProtocol)
+   {
+      DataCaches.resize(CoreCount);
+      InstructionCaches.resize(SplitFlag ? CoreCount : 0);
+      for (uint32_t Core = 0; Core < CoreCount; Core++)
+      {
+         for (PrivateCache *Private : {&DataCaches[Core], SplitFlag ? &InstructionCaches[Core] : (PrivateCache *)NULL})
+         {
+            if (Private == NULL)
+               continue;
+            if (Private == &DataCaches[0])
+               Private->Cache = &TopLevel;
+            else
+            {
+               OwnedCaches.emplace_back(new CacheModule(TopLevel.BLOCKSIZE, TopLevel.SIZE, TopLevel.ASSOC, 0, 0, TopLevel.ReplacementPolicy, ReplacementSeed + TraceCoreMax + OwnedCaches.size()));
+               Private->Cache = OwnedCaches.back().get();
+               Private->Cache->LowerLevel = TopLevel.LowerLevel;
+            }
+         }
+      }
+   }
+
+   // Every private cache, data caches first
+   vector<PrivateCache *> Caches()
+   {
+      vector<PrivateCache *> AllCaches;
+      for (PrivateCache &Private : DataCaches)
+         AllCaches.push_back(&Private);
+      for (PrivateCache &Private : InstructionCaches)
+         AllCaches.push_back(&Private);
+      return AllCaches;
+   }
+
+   // One trace record; SharedChain is the chain of the shared levels below the private caches.
+   // Returns false, simulating nothing, for a record of a core at or above CoreCount.
+   template <typename SharedChain>
+   bool Access(const TraceRecord &Record)
+   {
+      if (Record.Core >= CoreCount)
+         return false;
+      bool WriteFlag = Record.WriteFlag && !Record.InstructionFlag;
+      PrivateCache &Private = (Record.InstructionFlag && SplitFlag) ? InstructionCaches[Record.Core] : DataCaches[Record.Core];
+      CacheModule &Cache = *Private.Cache;
+      if (WriteFlag)
+         Cache.Statistics.WriteCount += 1;
+      else
+         Cache.Statistics.ReadCount += 1;
+
+      array<CacheAddress, 5> DataBits = Cache.GetTagParameters(Record.Address);
+      CacheAddress Block = DataBits[BlockB];
+      uint64_t CoreBit = 1ull << Record.Core;
+      uint8_t *SetState = Cache.CacheSetState(DataBits[IndexB]);
+      uint32_t Way = Cache.CacheHitWay(DataBits);
+      if (Way != Cache.ASSOC)
+      {
+         if (WriteFlag && (SetState[Way] & CacheSharedFlag))
+         {
+            Private.Statistics.Upgrades += 1;
+            ForEachCopy(Sharers[Block], DataBits, Private, [this, &DataBits](PrivateCache &Other, uint8_t &OtherState)
+                        { Invalidate(Other, DataBits); });
+            Sharers[Block] = CoreBit;
+            SetState[Way] &= ~CacheSharedFlag;
+         }
+         // UpdateCacheContents rewrites the state of a clean hit, so S is put back afterwards
+         uint8_t SharedState = SetState[Way] & CacheSharedFlag;
+         Cache.template UpdateCacheContents<DynamicReplacement, SharedChain>(DataBits, WriteFlag, false);
+         SetState[Way] |= SharedState;
+         return true;
+      }
+
+      if (WriteFlag)
+         Cache.Statistics.WriteMissCount += 1;
+      else
+         Cache.Statistics.ReadMissCount += 1;
+      if (!Private.InvalidatedBlocks.empty() && Private.InvalidatedBlocks.erase(Block))
+         Private.Statistics.CoherenceMisses += 1;
+
+      // The fill replaces this victim (Victim is stable until the fill)
+      uint32_t VictimWay = DynamicReplacement::Victim(Cache, DataBits[IndexB]);
+      bool VictimFlag = (SetState[VictimWay] & CacheValidFlag) != 0;
+      CacheAddress VictimBlock = Cache.CacheBlockAddress(DataBits[IndexB], VictimWay);
+
+      // Snoop the caches the directory lists: a dirty copy supplies the block, a write removes
+      // every copy and a read leaves them all shared
+      bool SharedFlag = false;
+      bool SuppliedFlag = false;
+      uint64_t &SharerMask = Sharers[Block];
+      ForEachCopy(SharerMask, DataBits, Private, [this, WriteFlag, Block, &DataBits, &SharedFlag, &SuppliedFlag](PrivateCache &Other, uint8_t &OtherState)
+                  {
+                     if (OtherState & CacheDirtyFlag)
+                     {
+                        Other.Statistics.Interventions += 1;
+                        SuppliedFlag = true;
+                     }
+                     if (WriteFlag)
+                        Invalidate(Other, DataBits);
+                     else
+                     {
+                        if ((OtherState & CacheDirtyFlag) && (Protocol == CoherenceMesi))
+                        {
+                           Other.Cache->template WriteBackBlock<SharedChain>(Block);
+                           OtherState &= ~CacheDirtyFlag;
+                        }
+                        OtherState |= CacheSharedFlag;
+                        SharedFlag = true;
+                     } });
+      SharerMask = WriteFlag ? CoreBit : (SharerMask | CoreBit);
+
+      if (SuppliedFlag)
+      {
+         // Cache-to-cache transfer: the shared levels only see this cache's victim
+         Cache.template CacheDirtyBitEviction<DynamicReplacement, SharedChain>(DataBits);
+         Cache.template UpdateCacheContents<DynamicReplacement, SharedChain>(DataBits, WriteFlag, true);
+      }
+      else
+         Cache.template DemandFill<DynamicReplacement, SharedChain>(DataBits, WriteFlag);
+      if (SharedFlag)
+         SetState[VictimWay] |= CacheSharedFlag;
+
+      // The core stays a sharer of the victim while its other private cache still holds it
+      if (VictimFlag)
+      {
+         PrivateCache *Sibling = !SplitFlag ? NULL : ((&Private == &DataCaches[Record.Core]) ? &InstructionCaches[Record.Core] : &DataCaches[Record.Core]);
+         if ((Sibling == NULL) || Sibling->Cache->CacheMiss(Sibling->Cache->GetTagParameters(VictimBlock << Cache.BlockOffsetBitCount)))
+         {
+            unordered_map<CacheAddress, uint64_t>::iterator VictimSharers = Sharers.find(VictimBlock);
+            if ((VictimSharers != Sharers.end()) && ((VictimSharers->second &= ~CoreBit) == 0))
+               Sharers.erase(VictimSharers);
+         }
+      }
+      return true;
+   }
+
+private:
+   vector<unique_ptr<CacheModule>> OwnedCaches;
+
+   // Calls Visit(cache, state byte) for each private cache except Requester holding the block
+   template <typename Visitor>
+   void ForEachCopy(uint64_t SharerMask, const array<CacheAddress, 5> &DataBits, PrivateCache &Requester, Visitor Visit)
+   {
+      for (; SharerMask != 0; SharerMask &= SharerMask - 1)
+      {
+         uint32_t Core = __builtin_ctzll(SharerMask);
+         for (PrivateCache *Other : {&DataCaches[Core], SplitFlag ? &InstructionCaches[Core] : (PrivateCache *)NULL})
+         {
+            if ((Other == NULL) || (Other == &Requester))
+               continue;
+            uint32_t OtherWay = Other->Cache->CacheHitWay(DataBits);
+            if (OtherWay != Other->Cache->ASSOC)
+               Visit(*Other, Other->Cache->CacheSetState(DataBits[IndexB])[OtherWay]);
+         }
+      }
+   }
+
+   void Invalidate(PrivateCache &Other, const array<CacheAddress, 5> &DataBits)
+   {
+      Other.Cache->InvalidateBlock(DataBits);
+      Other.Statistics.Invalidations += 1;
+      Other.InvalidatedBlocks.insert(DataBits[BlockB]);
+   }
+};
+
+#endif
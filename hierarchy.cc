@@ -0,0 +1,374 @@
+#include "hierarchy.h"
+#include <iostream>
+#include <array>
+#include <string>
+#include <string.h>
+#include <memory>
+using namespace std;
+
+const char *ReplacementPolicyNames[] = {"lru", "plru", "srrip", "brrip", "drrip", "fifo", "random"};
+
+// The policy by name; false for an unknown one
+bool FindReplacementPolicy(const char *PolicyName, uint32_t &Policy)
+{
+   for (Policy = LruPolicy; Policy <= RandomPolicy; Policy++)
+   {
+      if (strcmp(PolicyName, ReplacementPolicyNames[Policy]) == 0)
+         return true;
+   }
+   return false;
+}
+
+// What is wrong with a NAME[:DEGREE] prefetcher specification
+string PrefetcherError(const string &Specification)
+{
+   unique_ptr<Prefetcher> Engine;
+   return ParsePrefetcher(Specification, 1, Engine);
+}
+
+// The levels of a configuration, top first. The positional form is always an L1 and an L2, the
+// L2 of SIZE 0 when there is none, with the stream buffers on the last level in use.
+vector<LevelConfiguration> ConfigurationLevels(const SimulatorConfiguration &Configuration)
+{
+   vector<LevelConfiguration> Levels = Configuration.Levels;
+   if (Levels.empty())
+   {
+      bool L2Flag = (Configuration.L2Size != 0);
+      Levels.push_back({"L1", Configuration.L1Size, Configuration.L1Assoc, L2Flag ? 0 : Configuration.PrefetchN, L2Flag ? 0 : Configuration.PrefetchM, Configuration.L1Policy, Configuration.L1Prefetcher});
+      Levels.push_back({"L2", Configuration.L2Size, Configuration.L2Assoc, L2Flag ? Configuration.PrefetchN : 0, L2Flag ? Configuration.PrefetchM : 0, Configuration.L2Policy, L2Flag ? Configuration.L2Prefetcher : "none"});
+   }
+   else if (Levels.size() == 1)
+      Levels.push_back({"L2", 0, 0, 0, 0, LruPolicy});
+   return Levels;
+}
+
+// What is wrong with a configuration. A level in use needs at least one set, as CacheModule
+// divides SIZE by ASSOC * BLOCKSIZE; the core sharer masks hold TraceCoreMax bits, and the
+// timing model divides by its bus width.
+string ConfigurationError(const SimulatorConfiguration &Configuration)
+{
+   if ((Configuration.BlockSize == 0) || (Configuration.BlockSize % 2))
+      return "Input Block Size not a power of 2 " + to_string(Configuration.BlockSize);
+   if (!(Configuration.SampleFraction > 0) || (Configuration.SampleFraction > 1))
+      return "--sample needs a fraction in (0, 1]";
+   if (Configuration.CoreCount > TraceCoreMax)
+      return "--cores needs 1 to " + to_string(TraceCoreMax) + " cores";
+
+   vector<LevelConfiguration> Levels = ConfigurationLevels(Configuration);
+   if ((Configuration.CoreCount > 0) && ((Levels[0].Size == 0) || (Levels[0].PrefetchN > 0) || (Levels[0].Prefetcher != "none")))
+      return "--cores needs a top cache level without stream buffers or prefetcher"; // the private caches copy the top level
+   if (Configuration.TimingFlag)
+   {
+      const TimingConfiguration &Timing = Configuration.Timing;
+      if (!(Timing.ClockGhz > 0) || (Timing.MshrCount == 0) || (Timing.WriteBackBufferEntries == 0) || (Timing.DramBanks == 0) || (Timing.DramRowSize == 0) || (Timing.DramBusBytes == 0) || (Timing.Interval == 0))
+         return "Timing configuration sets a clock, count or size to 0";
+
+      // The levels in use run down to the first of SIZE 0, as in CacheHierarchy
+      size_t LevelCount = 1;
+      while ((LevelCount < Levels.size()) && (Levels[LevelCount].Size != 0))
+         LevelCount++;
+      for (const pair<string, uint32_t> &Latency : Timing.Latencies)
+      {
+         bool KnownFlag = false;
+         for (size_t Level = 0; Level < LevelCount; Level++)
+            KnownFlag |= (Levels[Level].Name == Latency.first);
+         if (!KnownFlag)
+            return "Timing latency for unknown level " + Latency.first;
+      }
+   }
+
+   for (const LevelConfiguration &Level : Levels)
+   {
+      if ((Level.Assoc > LruListMaxEntries) || (Level.PrefetchN > LruListMaxEntries))
+         return "ASSOC and PREF_N are limited to " + to_string(LruListMaxEntries);
+      if (Level.Size == 0)
+         continue;
+      if ((Level.Assoc == 0) || (Level.Size / Level.Assoc < Configuration.BlockSize))
+         return "Level " + Level.Name + " SIZE " + to_string(Level.Size) + " holds no set of ASSOC " + to_string(Level.Assoc) + " blocks";
+      if ((Level.Policy == PlruPolicy) && (Level.Assoc & (Level.Assoc - 1)))
+         return "plru needs a power of 2 ASSOC";
+      string Error = PrefetcherError(Level.Prefetcher);
+      if (!Error.empty())
+         return Error;
+   }
+   return "";
+}
+
+// The configuration of a hierarchy given level by level, as a --hierarchy file does. Error is
+// set to what is wrong with it, or "" when nothing is.
+SimulatorConfiguration LevelsConfiguration(uint32_t BlockSize, const vector<LevelConfiguration> &Levels, string &Error)
+{
+   SimulatorConfiguration Configuration = {BlockSize, 0, 0, 0, 0, 0, 0, LruPolicy, LruPolicy, Levels};
+   if ((BlockSize == 0) || Levels.empty() || (Levels.size() > CacheLevelsMax))
+   {
+      Error = "A hierarchy needs a blocksize and 1 to " + to_string(CacheLevelsMax) + " levels";
+      return Configuration;
+   }
+   for (const LevelConfiguration &Level : Levels)
+   {
+      if ((Level.Size == 0) || (Level.Assoc == 0))
+      {
+         Error = "Level " + Level.Name + " needs a non-zero SIZE and ASSOC";
+         return Configuration;
+      }
+   }
+
+   // The positional fields mirror the top two levels, for the L1/L2 report and sweep columns
+   const LevelConfiguration &TopLevel = Configuration.Levels[0];
+   Configuration.L1Size = TopLevel.Size;
+   Configuration.L1Assoc = TopLevel.Assoc;
+   Configuration.L1Policy = TopLevel.Policy;
+   if (Configuration.Levels.size() > 1)
+   {
+      Configuration.L2Size = Configuration.Levels[1].Size;
+      Configuration.L2Assoc = Configuration.Levels[1].Assoc;
+      Configuration.L2Policy = Configuration.Levels[1].Policy;
+   }
+   for (const LevelConfiguration &Level : Configuration.Levels)
+   {
+      Configuration.PrefetchN += Level.PrefetchN;
+      Configuration.PrefetchM += Level.PrefetchM;
+   }
+   Error = ConfigurationError(Configuration);
+   return Configuration;
+}
+
+template <typename Chain>
+bool ReadWriteCacheSubroutine(CacheAddress, bool, CacheModule &);
+
+template <typename Chain>
+size_t SimulateRecords(const TraceRecord *Records, size_t RecordCount, CacheHierarchy &Hierarchy)
+{
+   CacheModule &L1 = Hierarchy.L1;
+   CacheModule &L2 = Hierarchy.L2;
+   if (!Hierarchy.Sampler.Enabled)
+   {
+      // Software pipeline: while a record is simulated, the sets of the record
+      // SetPrefetchDistance further on are fetched into the host cache. The records are still
+      // simulated one by one in trace order, so the results are those of the plain loop.
+      size_t PrefetchCount = Hierarchy.PrefetchedLevels.empty() ? 0 : RecordCount;
+      for (size_t RecordCounter = 0; RecordCounter < min((size_t)SetPrefetchDistance, PrefetchCount); RecordCounter++)
+         Hierarchy.PrefetchSets(Records[RecordCounter].Address);
+      for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+      {
+         if (RecordCounter + SetPrefetchDistance < PrefetchCount)
+            Hierarchy.PrefetchSets(Records[RecordCounter + SetPrefetchDistance].Address);
+         ReadWriteCacheSubroutine<Chain>(Records[RecordCounter].Address, Records[RecordCounter].WriteFlag, L1);
+      }
+      return RecordCount;
+   }
+
+   // Set sampling: accesses to unsampled L1 sets are dropped on the index alone, before any
+   // cache state is touched; the rest also feed the per-class statistics
+   SetSampler &Sampler = Hierarchy.Sampler;
+   for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+   {
+      uint32_t SetIndex = (Records[RecordCounter].Address >> L1.BlockOffsetBitCount) & L1.IndexMask;
+      if (!L1.SampledSets[SetIndex])
+         continue;
+
+      uint64_t L1Misses = L1.Statistics.DemandMisses(true);
+      uint64_t L2Accesses = L2.Statistics.ReadCount;
+      uint64_t L2Misses = L2.Statistics.ReadMissCount;
+      ReadWriteCacheSubroutine<Chain>(Records[RecordCounter].Address, Records[RecordCounter].WriteFlag, L1);
+
+      SampleClassStatistics &Statistics = Sampler.ClassStatistics[SetIndex & Sampler.ClassMask];
+      Statistics.L1Accesses += 1;
+      Statistics.L1Misses += L1.Statistics.DemandMisses(true) - L1Misses;
+      Statistics.L2Accesses += L2.Statistics.ReadCount - L2Accesses;
+      Statistics.L2Misses += L2.Statistics.ReadMissCount - L2Misses;
+   }
+   return RecordCount;
+}
+
+// The replacement policies are picked here, once per hierarchy, so the per-access path is a
+// separate instantiation for every L1 policy over the chain of levels below it. One and two
+// level hierarchies get every policy combination; deeper levels switch on their policy at run time.
+template <typename LowerChain>
+SimulateRecordsFunction SelectSimulateRecordsL1(uint32_t L1Policy)
+{
+   switch (L1Policy)
+   {
+   case PlruPolicy:
+      return SimulateRecords<CacheLevel<PlruReplacement, LowerChain>>;
+   case SrripPolicy:
+      return SimulateRecords<CacheLevel<SrripReplacement, LowerChain>>;
+   case BrripPolicy:
+      return SimulateRecords<CacheLevel<BrripReplacement, LowerChain>>;
+   case DrripPolicy:
+      return SimulateRecords<CacheLevel<DrripReplacement, LowerChain>>;
+   case FifoPolicy:
+      return SimulateRecords<CacheLevel<FifoReplacement, LowerChain>>;
+   case RandomPolicy:
+      return SimulateRecords<CacheLevel<RandomReplacement, LowerChain>>;
+   default:
+      return SimulateRecords<CacheLevel<LruReplacement, LowerChain>>;
+   }
+}
+
+SimulateRecordsFunction SelectSimulateRecordsL2(uint32_t L1Policy, uint32_t L2Policy)
+{
+   switch (L2Policy)
+   {
+   case PlruPolicy:
+      return SelectSimulateRecordsL1<CacheLevel<PlruReplacement, MemoryLevel>>(L1Policy);
+   case SrripPolicy:
+      return SelectSimulateRecordsL1<CacheLevel<SrripReplacement, MemoryLevel>>(L1Policy);
+   case BrripPolicy:
+      return SelectSimulateRecordsL1<CacheLevel<BrripReplacement, MemoryLevel>>(L1Policy);
+   case DrripPolicy:
+      return SelectSimulateRecordsL1<CacheLevel<DrripReplacement, MemoryLevel>>(L1Policy);
+   case FifoPolicy:
+      return SelectSimulateRecordsL1<CacheLevel<FifoReplacement, MemoryLevel>>(L1Policy);
+   case RandomPolicy:
+      return SelectSimulateRecordsL1<CacheLevel<RandomReplacement, MemoryLevel>>(L1Policy);
+   default:
+      return SelectSimulateRecordsL1<CacheLevel<LruReplacement, MemoryLevel>>(L1Policy);
+   }
+}
+
+// Depth levels over memory (or Bottom), each dispatching on its own policy
+template <uint32_t Depth, typename Bottom = MemoryLevel>
+struct DynamicLevels
+{
+   typedef CacheLevel<DynamicReplacement, typename DynamicLevels<Depth - 1, Bottom>::Chain> Chain;
+};
+
+template <typename Bottom>
+struct DynamicLevels<0, Bottom>
+{
+   typedef Bottom Chain;
+};
+
+template <uint32_t Depth>
+SimulateRecordsFunction SelectSimulateRecordsDeep(uint32_t L1Policy, uint32_t LevelCount)
+{
+   if constexpr (Depth < CacheLevelsMax)
+   {
+      if (LevelCount > Depth)
+         return SelectSimulateRecordsDeep<Depth + 1>(L1Policy, LevelCount);
+   }
+   return SelectSimulateRecordsL1<typename DynamicLevels<Depth - 1>::Chain>(L1Policy);
+}
+
+SimulateRecordsFunction SelectSimulateRecords(const vector<uint32_t> &Policies)
+{
+   if (Policies.size() == 1)
+      return SelectSimulateRecordsL1<MemoryLevel>(Policies[0]);
+   if (Policies.size() == 2)
+      return SelectSimulateRecordsL2(Policies[0], Policies[1]);
+   return SelectSimulateRecordsDeep<3>(Policies[0], (uint32_t)Policies.size());
+}
+
+// --cores: every record goes to its core's private caches; those and the shared levels below
+// them switch on their policies at run time, with one instantiation per shared depth
+template <typename SharedChain>
+size_t SimulateCoreRecords(const TraceRecord *Records, size_t RecordCount, CacheHierarchy &Hierarchy)
+{
+   CoherentCores &Cores = *Hierarchy.Cores;
+   for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+   {
+      if (!Cores.Access<SharedChain>(Records[RecordCounter]))
+         return RecordCounter;
+   }
+   return RecordCount;
+}
+
+template <uint32_t SharedDepth>
+SimulateRecordsFunction SelectSimulateCoreRecordsShared(uint32_t LevelCount)
+{
+   if constexpr (SharedDepth + 1 < CacheLevelsMax)
+   {
+      if (LevelCount > SharedDepth + 1)
+         return SelectSimulateCoreRecordsShared<SharedDepth + 1>(LevelCount);
+   }
+   return SimulateCoreRecords<typename DynamicLevels<SharedDepth>::Chain>;
+}
+
+SimulateRecordsFunction SelectSimulateCoreRecords(uint32_t LevelCount)
+{
+   return SelectSimulateCoreRecordsShared<0>(LevelCount);
+}
+
+// --timing: every level switches on its policy at run time over TimedMemoryLevel, and the timing
+// model reads the counters around each access
+template <typename Chain>
+size_t SimulateTimedRecords(const TraceRecord *Records, size_t RecordCount, CacheHierarchy &Hierarchy)
+{
+   CacheModule &L1 = Hierarchy.L1;
+   TimingModel &Timing = *Hierarchy.Timing;
+   for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+   {
+      Timing.BeginAccess();
+      ReadWriteCacheSubroutine<Chain>(Records[RecordCounter].Address, Records[RecordCounter].WriteFlag, L1);
+      Timing.EndAccess(Records[RecordCounter].Address);
+   }
+   return RecordCount;
+}
+
+template <uint32_t Depth>
+SimulateRecordsFunction SelectSimulateTimedRecordsDeep(uint32_t LevelCount)
+{
+   if constexpr (Depth < CacheLevelsMax)
+   {
+      if (LevelCount > Depth)
+         return SelectSimulateTimedRecordsDeep<Depth + 1>(LevelCount);
+   }
+   return SimulateTimedRecords<typename DynamicLevels<Depth, TimedMemoryLevel>::Chain>;
+}
+
+SimulateRecordsFunction SelectSimulateTimedRecords(uint32_t LevelCount)
+{
+   return SelectSimulateTimedRecordsDeep<1>(LevelCount);
+}
+
+// One trace access. Chain holds the policies of the levels in use, L1 first, and ends in
+// MemoryLevel; the L1 scenarios are handled here and every level below reads, fills and writes
+// back through the CacheModule it is chained to.
+template <typename Chain>
+bool ReadWriteCacheSubroutine(CacheAddress TagAddress, bool WriteFlag, CacheModule &L1)
+{
+   typedef typename Chain::Policy L1Policy;
+   typedef typename Chain::Lower L2Chain;
+
+   if (WriteFlag)
+      L1.Statistics.WriteCount += 1;
+   else
+      L1.Statistics.ReadCount += 1;
+
+   // Each level decodes the trace address once; L2 only when the access actually reaches it
+   array<CacheAddress, 5> L1DataBits = L1.GetTagParameters(TagAddress);
+
+   bool L1CacheMiss = L1.CacheMiss(L1DataBits);
+   bool L1DemandMiss = false;
+   if (L1CacheMiss)
+   {
+      if (L1.PrefetchMiss(L1DataBits))
+      {
+         L1DemandMiss = true;
+         if (WriteFlag)
+            L1.Statistics.WriteMissCount += 1;
+         else
+            L1.Statistics.ReadMissCount += 1;
+
+         // L1 Scenario #1 with memory below, L2 Scenarios #1-#4 otherwise
+         L1.DemandFill<L1Policy, L2Chain>(L1DataBits, WriteFlag);
+      }
+      else
+      {
+         L1.Statistics.PrefetchHitCount += 1;
+         L1.CacheDirtyBitEviction<L1Policy, L2Chain>(L1DataBits);
+         L1.UpdateCacheContents<L1Policy, L2Chain>(L1DataBits, WriteFlag, true); // L1 Scenario #2
+      }
+   }
+   else // L1 HIT
+   {
+      if (L1.PrefetchMiss(L1DataBits))
+         L1.UpdateCacheContents<L1Policy, L2Chain>(L1DataBits, WriteFlag, false); // L1 Scenario #3 OK
+      else
+         L1.UpdateCacheContents<L1Policy, L2Chain>(L1DataBits, WriteFlag, true); // L1 Scenario #4
+   }
+   if (L1.PrefetchEngine)
+      L1.TrainPrefetchEngine<L1Policy, L2Chain>(L1DataBits[BlockB], L1CacheMiss, L1DemandMiss);
+   return true;
+}
@@ -0,0 +1,245 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include "sim.h"
+#include "trace_reader.h"
+#include "set_sampling.h"
+#include "coherence.h"
+#include "timing.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The simulation core, kept apart from the sim command line so other programs can embed it
+// (libcachesim, see cachesim.h for the C interface). A CacheHierarchy is built from a
+// SimulatorConfiguration, which carries everything the run depends on, and is driven from
+// memory:
+//   - Access() simulates one reference
+//   - Simulate() simulates a batch of decoded TraceRecords
+//   - LevelStatistics() reads a level's counters at any point
+//   - Finish() settles the counters at the end of the run
+// A configuration must pass ConfigurationError first; the library reports what is wrong rather
+// than exiting.
+
+#define CacheLevelsMax 6
+#define SetPrefetchDistance 8               // records between a set's host prefetch and its lookup
+#define SetPrefetchMinimumSize (256 * 1024) // set arrays smaller than this stay in the host caches anyway
+
+extern const char *ReplacementPolicyNames[];
+
+// One level of a --hierarchy file
+struct LevelConfiguration
+{
+   string Name;
+   uint32_t Size;
+   uint32_t Assoc;
+   uint32_t PrefetchN;
+   uint32_t PrefetchM;
+   uint32_t Policy;
+   string Prefetcher = "none"; // prefetcher.h engine as NAME[:DEGREE]
+};
+
+// One point of the design space: the 7 positional parameters plus the replacement policies, or
+// the levels of a --hierarchy file (Levels is empty for the positional form), and the options
+// that apply to the whole hierarchy
+struct SimulatorConfiguration
+{
+   uint32_t BlockSize;
+   uint32_t L1Size;
+   uint32_t L1Assoc;
+   uint32_t L2Size;
+   uint32_t L2Assoc;
+   uint32_t PrefetchN;
+   uint32_t PrefetchM;
+   uint32_t L1Policy;
+   uint32_t L2Policy;
+   vector<LevelConfiguration> Levels;
+   string L1Prefetcher = "none"; // engines of the positional form
+   string L2Prefetcher = "none";
+   uint64_t ReplacementSeed = 1;
+   double SampleFraction = 1;
+   uint32_t CoreCount = 0; // 0 simulates the trace on a single core, ignoring core IDs
+   bool SplitL1 = false;
+   uint32_t CoherenceProtocol = CoherenceMesi;
+   bool TimingFlag = false;
+   TimingConfiguration Timing;
+};
+
+// The checks below return what is wrong, or "" when nothing is; the library never exits on a
+// bad configuration, so printing the error and exiting is left to sim
+bool FindReplacementPolicy(const char *PolicyName, uint32_t &Policy);
+string PrefetcherError(const string &Specification);
+vector<LevelConfiguration> ConfigurationLevels(const SimulatorConfiguration &Configuration);
+SimulatorConfiguration LevelsConfiguration(uint32_t BlockSize, const vector<LevelConfiguration> &Levels, string &Error);
+string ConfigurationError(const SimulatorConfiguration &Configuration);
+
+struct CacheHierarchy;
+typedef size_t (*SimulateRecordsFunction)(const TraceRecord *, size_t, CacheHierarchy &);
+SimulateRecordsFunction SelectSimulateRecords(const vector<uint32_t> &);
+SimulateRecordsFunction SelectSimulateCoreRecords(uint32_t);
+SimulateRecordsFunction SelectSimulateTimedRecords(uint32_t);
+
+// A complete cache hierarchy over memory, each level chained to the next through LowerLevel,
+// with the trace loop instantiated for its depth and policies
+struct CacheHierarchy
+{
+   SimulatorConfiguration Configuration;
+   vector<unique_ptr<CacheModule>> Levels;
+   uint32_t LevelCount; // levels in use; a SIZE 0 L2 is kept only for the report
+   CacheModule &L1;
+   CacheModule &L2;
+   SimulateRecordsFunction SimulateRecords;
+   SetSampler Sampler;
+   unique_ptr<CoherentCores> Cores; // CoreCount > 0: L1 is core 0's private data cache
+   unique_ptr<TimingModel> Timing;
+   vector<CacheModule *> PrefetchedLevels; // levels whose sets the trace loop prefetches ahead of the lookup
+
+   static vector<unique_ptr<CacheModule>> CreateLevels(const SimulatorConfiguration &InputConfiguration)
+   {
+      vector<unique_ptr<CacheModule>> Levels;
+      for (const LevelConfiguration &Level : ConfigurationLevels(InputConfiguration))
+      {
+         Levels.emplace_back(new CacheModule(InputConfiguration.BlockSize, Level.Size, Level.Assoc, Level.PrefetchN, Level.PrefetchM, Level.Policy, InputConfiguration.ReplacementSeed + Levels.size()));
+         if (Level.Size != 0)
+            ParsePrefetcher(Level.Prefetcher, InputConfiguration.BlockSize, Levels.back()->PrefetchEngine); // checked by ConfigurationError
+      }
+      return Levels;
+   }
+
+   CacheHierarchy(const SimulatorConfiguration &InputConfiguration)
+       : Configuration(InputConfiguration),
+         Levels(CreateLevels(InputConfiguration)),
+         LevelCount(1),
+         L1(*Levels[0]),
+         L2(*Levels[1])
+   {
+      while ((LevelCount < Levels.size()) && (Levels[LevelCount]->SIZE != 0))
+      {
+         Levels[LevelCount - 1]->LowerLevel = Levels[LevelCount].get();
+         LevelCount++;
+      }
+
+      vector<uint32_t> Policies;
+      for (uint32_t Level = 0; Level < LevelCount; Level++)
+      {
+         Policies.push_back(Levels[Level]->ReplacementPolicy);
+         if (Levels[Level]->CacheSets.size() * sizeof(CacheSetLine) >= SetPrefetchMinimumSize)
+            PrefetchedLevels.push_back(Levels[Level].get());
+      }
+      SimulateRecords = SelectSimulateRecords(Policies);
+      if (Configuration.CoreCount > 0)
+      {
+         Cores.reset(new CoherentCores(L1, Configuration.CoreCount, Configuration.SplitL1, Configuration.CoherenceProtocol, Configuration.ReplacementSeed));
+         SimulateRecords = SelectSimulateCoreRecords(LevelCount);
+      }
+      if (Configuration.TimingFlag)
+      {
+         vector<CacheModule *> TimedLevels;
+         vector<string> LevelNames;
+         for (uint32_t Level = 0; Level < LevelCount; Level++)
+         {
+            TimedLevels.push_back(Levels[Level].get());
+            LevelNames.push_back(ConfigurationLevels(Configuration)[Level].Name);
+         }
+         Timing.reset(new TimingModel(Configuration.Timing, TimedLevels, LevelNames));
+         Levels[LevelCount - 1]->MemoryRequests = &Timing->Requests;
+         SimulateRecords = SelectSimulateTimedRecords(LevelCount);
+      }
+
+      // Sample on the index bits shared by every level so sampled sets see all their traffic
+      if (Configuration.SampleFraction < 1)
+      {
+         uint32_t SampleBitCount = L1.IndexBitCount;
+         for (uint32_t Level = 1; Level < LevelCount; Level++)
+            SampleBitCount = min(SampleBitCount, Levels[Level]->IndexBitCount);
+         Sampler.Select(SampleBitCount, Configuration.SampleFraction, Configuration.ReplacementSeed);
+         L1.SampleSets(Sampler.SampledClasses, Sampler.SampleBitCount);
+      }
+   }
+
+   // Returns the number of records simulated, which is less than RecordCount only when a record
+   // names a core at or above CoreCount; the records from that one on are left unsimulated
+   size_t Simulate(const TraceRecord *Records, size_t RecordCount)
+   {
+      return SimulateRecords(Records, RecordCount, *this);
+   }
+
+   // Host prefetch of the sets Address maps to in the PrefetchedLevels (always inlined, see
+   // CacheModule::PrefetchSet)
+   __attribute__((always_inline)) void PrefetchSets(CacheAddress Address) const
+   {
+      for (CacheModule *Level : PrefetchedLevels)
+         Level->PrefetchSet(Address);
+   }
+
+   // One reference; Operation is a trace operation byte (TraceOperationWrite,
+   // TraceOperationInstruction and the core above TraceOperationCoreShift). Returns 1 on a demand
+   // miss in the top level, 0 on a hit and -1, simulating nothing, when the core is at or above
+   // CoreCount.
+   int Access(CacheAddress Address, uint8_t Operation)
+   {
+      TraceRecord Record;
+      Record.Address = Address;
+      TraceSetOperation(Record, Operation);
+      const CacheStatistics &Statistics = TopLevelCache(Record).Statistics;
+      uint64_t TopLevelMisses = Statistics.DemandMisses(true);
+      if (SimulateRecords(&Record, 1, *this) == 0)
+         return -1;
+      return (Statistics.DemandMisses(true) != TopLevelMisses) ? 1 : 0;
+   }
+
+   // The top level cache a record goes to: L1, or with CoreCount > 0 its core's private cache.
+   // For a core out of range it is L1, whose counters the rejected record leaves alone.
+   CacheModule &TopLevelCache(const TraceRecord &Record)
+   {
+      if ((Cores == NULL) || (Record.Core >= Cores->CoreCount))
+         return L1;
+      return *((Record.InstructionFlag && Cores->SplitFlag) ? Cores->InstructionCaches[Record.Core] : Cores->DataCaches[Record.Core]).Cache;
+   }
+
+   // The counters of a level in use; with CoreCount > 0 the top level's are the private caches' totals
+   CacheStatistics LevelStatistics(uint32_t Level) const
+   {
+      if ((Level > 0) || (Cores == NULL))
+         return Levels[Level]->Statistics;
+      CacheStatistics Total;
+      for (const vector<PrivateCache> *Caches : {&Cores->DataCaches, &Cores->InstructionCaches})
+      {
+         for (const PrivateCache &Private : *Caches)
+            Total.Add(Private.Cache->Statistics);
+      }
+      return Total;
+   }
+
+   // Prefetched blocks no longer in the cache at the end of the run were evicted unused
+   void FinishPrefetching()
+   {
+      for (unique_ptr<CacheModule> &Level : Levels)
+      {
+         CacheModule &Cache = *Level;
+         if (Cache.PrefetchEngine)
+            Cache.PrefetchEngine->Sweep([&Cache](CacheAddress Block)
+                                        { return !Cache.CacheMiss(Cache.GetTagParameters(Block << Cache.BlockOffsetBitCount)); });
+      }
+   }
+
+   // Scales a set-sampled run's counters up to the whole cache
+   void FinishSampling()
+   {
+      if (!Sampler.Enabled)
+         return;
+      for (unique_ptr<CacheModule> &Level : Levels)
+         Level->ScaleStatistics(Sampler.Scale());
+   }
+
+   // After the last access, before the final counters are read
+   void Finish()
+   {
+      FinishPrefetching();
+      FinishSampling();
+   }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "sim.h"
+#include <chrono>
+#include <random>
+using namespace std;
+
+// Lookup microbenchmark: CacheMiss on the flat set layout against the
+// vector<vector<...>> layout CacheModule used before, on identical contents.
+// usage: lookup_bench [lookups]
+
+struct NestedVectorTagStore
+{
+   uint32_t ASSOC;
+   vector<vector<bool>> CacheValidBit;
+   vector<vector<uint32_t>> CacheTag;
+
+   NestedVectorTagStore(CacheModule &Cache)
+   {
+      ASSOC = Cache.ASSOC;
+      CacheValidBit.resize(Cache.NumberOfSets, vector<bool>(ASSOC, false));
+      CacheTag.resize(Cache.NumberOfSets, vector<uint32_t>(ASSOC, 0));
+      for (uint32_t SetCounter = 0; SetCounter < Cache.NumberOfSets; SetCounter++)
+      {
+         for (uint32_t Way = 0; Way < ASSOC; Way++)
+         {
+            CacheTag[SetCounter][Way] = Cache.CacheSetTag(SetCounter)[Way];
+            CacheValidBit[SetCounter][Way] = Cache.CacheSetState(SetCounter)[Way] & CacheValidFlag;
+         }
+      }
+   }
+
+   bool CacheMiss(const array<CacheAddress, 5> &TagIndividualDataBits)
+   {
+      for (uint32_t AssociativitySearch = 0; AssociativitySearch < ASSOC; AssociativitySearch++)
+      {
+         if ((CacheTag[TagIndividualDataBits[IndexB]][AssociativitySearch] == TagIndividualDataBits[TagB]) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativitySearch]))
+            return false;
+      }
+      return true;
+   }
+};
+
+template <typename LookupFunction>
+double NanosecondsPerLookup(const vector<array<CacheAddress, 5>> &Lookups, uint32_t &HitCount, LookupFunction Lookup)
+{
+   chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+   HitCount = 0;
+   for (size_t LookupCounter = 0; LookupCounter < Lookups.size(); LookupCounter++)
+      HitCount += !Lookup(Lookups[LookupCounter]);
+   chrono::steady_clock::time_point Stop = chrono::steady_clock::now();
+   return chrono::duration<double, nano>(Stop - Start).count() / Lookups.size();
+}
+
+int main(int ArgumentCount, char *ArgumentVariables[])
+{
+   uint32_t LookupCount = (ArgumentCount > 1) ? (uint32_t)atoi(ArgumentVariables[1]) : 20000000;
+   const uint32_t Configurations[][3] = {{64, 32768, 8}, {64, 1048576, 16}, {64, 4194304, 16}, {64, 8388608, 16}, {64, 8388608, 32}};
+
+   cout << "BLOCKSIZE  SIZE       ASSOC  nested(ns)  flat(ns)  hits" << endl;
+   for (const uint32_t *Configuration : Configurations)
+   {
+      CacheModule Cache(Configuration[0], Configuration[1], Configuration[2], 0, 0);
+      mt19937 Generator(1);
+      uniform_int_distribution<uint32_t> Footprint(0, 2 * Configuration[1] - 1);
+
+      // Fill with a footprint twice the capacity so roughly half of the probes hit
+      for (uint32_t FillCounter = 0; FillCounter < 4 * (Configuration[1] / Configuration[0]); FillCounter++)
+         Cache.UpdateCacheContents(Cache.GetTagParameters(Footprint(Generator)), false, false);
+
+      vector<array<CacheAddress, 5>> Lookups(LookupCount);
+      for (uint32_t LookupCounter = 0; LookupCounter < LookupCount; LookupCounter++)
+         Lookups[LookupCounter] = Cache.GetTagParameters(Footprint(Generator));
+
+      NestedVectorTagStore Nested(Cache);
+      uint32_t NestedHits = 0;
+      uint32_t FlatHits = 0;
+      double NestedTime = NanosecondsPerLookup(Lookups, NestedHits, [&](const array<CacheAddress, 5> &Bits) { return Nested.CacheMiss(Bits); });
+      double FlatTime = NanosecondsPerLookup(Lookups, FlatHits, [&](const array<CacheAddress, 5> &Bits) { return Cache.CacheMiss(Bits); });
+      if (NestedHits != FlatHits)
+      {
+         cout << "Error: layouts disagree on hit count " << NestedHits << " != " << FlatHits << '\n';
+         exit(EXIT_FAILURE);
+      }
+
+      cout << left << setw(11) << Configuration[0] << setw(11) << Configuration[1] << setw(7) << Configuration[2]
+           << fixed << setprecision(2) << setw(12) << NestedTime << setw(10) << FlatTime << FlatHits << endl;
+   }
+   return (0);
+}
@@ -0,0 +1,364 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "address_width.h"
+
+using namespace std;
+
+// Prefetcher engines for CacheModule, next to the PREF_N x PREF_M stream buffers. An engine sees
+// every demand access to its level after the access is handled and names blocks to prefetch;
+// the level fills them straight into its cache from the next level down (prefetch reads, like
+// the stream buffers'). The base class follows each prefetched block until a demand access
+// uses it (useful) or finds it gone (useless), for the accuracy, coverage and lead reported per
+// level. Engines are chosen per level as NAME[:DEGREE]:
+//   nextline  tagged next-N-line: a miss, or the first use of a prefetched block, fetches the
+//             next DEGREE blocks (default 1)
+//   stride    reference prediction table. Traces carry no PC, so entries are keyed by 4 KB
+//             region; a stride seen twice in a row prefetches DEGREE strides ahead (default 2)
+//   ghb       global history buffer with delta correlation (G/DC): the last two deltas of the
+//             miss stream are looked up in the history and the deltas that followed them last
+//             time are replayed, DEGREE deep (default 4)
+//   bo        Best-Offset: learning rounds score a fixed list of offsets against a table of
+//             recent requests, and each miss or prefetch hit prefetches the best offset ahead
+
+#define StrideRegionBytes 4096
+#define StrideTableEntries 256
+#define StrideConfidenceMax 3
+#define StrideConfidenceSteady 2
+#define GhbEntries 256
+#define GhbIndexEntries 1024
+#define BestOffsetRecentEntries 256
+#define BestOffsetScoreMax 31
+#define BestOffsetRoundMax 100
+#define BestOffsetBadScore 1
+#define PrefetchBlockInvalid CacheAddressMax
+
+class Prefetcher
+{
+public:
+   string Specification;
+   uint32_t Degree = 1;
+
+   // Statistics
+   uint64_t AccessCount = 0;  // demand accesses seen
+   uint64_t IssuedCount = 0;  // blocks filled into the cache
+   uint64_t RedundantCount = 0; // candidates dropped because the level already held them
+   uint64_t UsefulCount = 0;
+   uint64_t UselessCount = 0; // evicted before any demand access used them
+   uint64_t LeadSum = 0;      // accesses between each useful prefetch and its first use
+
+   virtual ~Prefetcher()
+   {
+   }
+
+   // Learns from a demand access and appends the blocks to prefetch to Candidates.
+   // PrefetchHitFlag marks the first use of a block this engine prefetched.
+   virtual void Train(CacheAddress BlockAddress, bool MissFlag, bool PrefetchHitFlag, vector<CacheAddress> &Candidates) = 0;
+
+   // Accounts a demand access; returns whether it is the first use of a prefetched block
+   bool DemandAccess(CacheAddress BlockAddress, bool CacheMissFlag)
+   {
+      AccessCount += 1;
+      if (Outstanding.empty())
+         return false;
+      unordered_map<CacheAddress, uint64_t>::iterator Prefetch = Outstanding.find(BlockAddress);
+      if (Prefetch == Outstanding.end())
+         return false;
+      bool UsefulFlag = !CacheMissFlag;
+      if (UsefulFlag)
+      {
+         UsefulCount += 1;
+         LeadSum += AccessCount - Prefetch->second;
+      }
+      else
+         UselessCount += 1;
+      Outstanding.erase(Prefetch);
+      return UsefulFlag;
+   }
+
+   // A prefetch filled into the cache. Blocks no longer resident are counted useless once there
+   // are more outstanding than the cache can hold, and at the end of the run.
+   template <typename ResidentFunction>
+   void Issue(CacheAddress BlockAddress, uint32_t CapacityBlocks, ResidentFunction Resident)
+   {
+      IssuedCount += 1;
+      if (Outstanding.size() >= 2 * (size_t)CapacityBlocks)
+         Sweep(Resident);
+      // Only blocks the level does not hold are prefetched, so an earlier copy was evicted unused
+      pair<unordered_map<CacheAddress, uint64_t>::iterator, bool> Prefetch = Outstanding.insert(make_pair(BlockAddress, AccessCount));
+      if (!Prefetch.second)
+      {
+         UselessCount += 1;
+         Prefetch.first->second = AccessCount;
+      }
+   }
+
+   template <typename ResidentFunction>
+   void Sweep(ResidentFunction Resident)
+   {
+      for (unordered_map<CacheAddress, uint64_t>::iterator Prefetch = Outstanding.begin(); Prefetch != Outstanding.end();)
+      {
+         if (Resident(Prefetch->first))
+            ++Prefetch;
+         else
+         {
+            UselessCount += 1;
+            Prefetch = Outstanding.erase(Prefetch);
+         }
+      }
+   }
+
+   // Set sampling scales the counts up with the cache's
+   void ScaleStatistics(double Scale)
+   {
+      for (uint64_t *Counter : {&AccessCount, &IssuedCount, &RedundantCount, &UsefulCount, &UselessCount, &LeadSum})
+         *Counter = (uint64_t)llround(*Counter * Scale);
+   }
+
+   // Prefetched blocks still in the cache and not yet used
+   uint64_t UnusedCount() const
+   {
+      return Outstanding.size();
+   }
+
+private:
+   unordered_map<CacheAddress, uint64_t> Outstanding; // prefetched block -> AccessCount at issue
+};
+
+class NextLinePrefetcher : public Prefetcher
+{
+public:
+   void Train(CacheAddress BlockAddress, bool MissFlag, bool PrefetchHitFlag, vector<CacheAddress> &Candidates)
+   {
+      if (!MissFlag && !PrefetchHitFlag)
+         return;
+      for (uint32_t Distance = 1; Distance <= Degree; Distance++)
+         Candidates.push_back(BlockAddress + Distance);
+   }
+};
+
+// Confidence rises on a repeated stride and falls on another; the stride is only replaced once
+// confidence is gone
+class StridePrefetcher : public Prefetcher
+{
+public:
+   uint32_t RegionShift;
+
+   StridePrefetcher(uint32_t BlockSize)
+   {
+      RegionShift = 0;
+      while ((BlockSize << (RegionShift + 1)) <= StrideRegionBytes)
+         RegionShift++;
+      Table.resize(StrideTableEntries);
+   }
+
+   void Train(CacheAddress BlockAddress, bool MissFlag, bool PrefetchHitFlag, vector<CacheAddress> &Candidates)
+   {
+      CacheAddress Region = BlockAddress >> RegionShift;
+      StrideEntry &Entry = Table[((CacheAddressFold(Region) * 0x9e3779b1u) >> 16) % StrideTableEntries];
+      if (!Entry.Valid || (Entry.Region != Region))
+      {
+         Entry = {Region, BlockAddress, 0, 0, true};
+         return;
+      }
+      CacheAddressDelta Delta = (CacheAddressDelta)(BlockAddress - Entry.LastBlock);
+      if (Delta == 0)
+         return;
+      if (Delta == Entry.Stride)
+      {
+         if (Entry.Confidence < StrideConfidenceMax)
+            Entry.Confidence++;
+      }
+      else if (Entry.Confidence > 0)
+         Entry.Confidence--;
+      else
+         Entry.Stride = Delta;
+      Entry.LastBlock = BlockAddress;
+      if (Entry.Confidence >= StrideConfidenceSteady)
+      {
+         for (uint32_t Distance = 1; Distance <= Degree; Distance++)
+            Candidates.push_back(BlockAddress + (CacheAddress)(Entry.Stride * (CacheAddressDelta)Distance));
+      }
+   }
+
+private:
+   struct StrideEntry
+   {
+      CacheAddress Region = 0;
+      CacheAddress LastBlock = 0;
+      CacheAddressDelta Stride = 0;
+      uint32_t Confidence = 0;
+      bool Valid = false;
+   };
+   vector<StrideEntry> Table;
+};
+
+// The history is a ring of the last GhbEntries miss blocks; the index maps a delta pair to the
+// position where it last ended
+class GhbPrefetcher : public Prefetcher
+{
+public:
+   GhbPrefetcher()
+   {
+      History.resize(GhbEntries);
+      Index.resize(GhbIndexEntries);
+   }
+
+   void Train(CacheAddress BlockAddress, bool MissFlag, bool PrefetchHitFlag, vector<CacheAddress> &Candidates)
+   {
+      if (!MissFlag && !PrefetchHitFlag)
+         return;
+      uint64_t Position = HistoryCount++;
+      History[Position % GhbEntries] = BlockAddress;
+      if (Position < 2)
+         return;
+
+      CacheAddress DeltaKey[2] = {BlockAddress - HistoryBlock(Position - 1), HistoryBlock(Position - 1) - HistoryBlock(Position - 2)};
+      uint64_t Hash = ((uint64_t)(uint32_t)DeltaKey[0] << 32) | (uint32_t)DeltaKey[1];
+      GhbIndexEntry &Entry = Index[((Hash * 0x9e3779b97f4a7c15ull) >> 32) % GhbIndexEntries];
+      if (Entry.Valid && (Entry.Key[0] == DeltaKey[0]) && (Entry.Key[1] == DeltaKey[1]) && (Position - Entry.Position < GhbEntries))
+      {
+         CacheAddress Prediction = BlockAddress;
+         for (uint64_t Next = Entry.Position + 1; (Next < Position) && (Next <= Entry.Position + Degree); Next++)
+         {
+            Prediction += HistoryBlock(Next) - HistoryBlock(Next - 1);
+            Candidates.push_back(Prediction);
+         }
+      }
+      Entry = {{DeltaKey[0], DeltaKey[1]}, Position, true};
+   }
+
+private:
+   struct GhbIndexEntry
+   {
+      CacheAddress Key[2] = {0, 0}; // the delta pair
+      uint64_t Position = 0;
+      bool Valid = false;
+   };
+   vector<CacheAddress> History;
+   uint64_t HistoryCount = 0;
+   vector<GhbIndexEntry> Index;
+
+   CacheAddress HistoryBlock(uint64_t Position) const
+   {
+      return History[Position % GhbEntries];
+   }
+};
+
+// Each trigger (a miss or a prefetch hit) tests one offset of the list: the offset scores when
+// the block that far back is in the recent requests table. A round ends when an offset reaches
+// BestOffsetScoreMax or after BestOffsetRoundMax passes over the list; the top scorer becomes
+// the prefetch offset, or prefetching pauses when even it scored at most BestOffsetBadScore.
+// With no timing, a prefetch's base block enters the recent requests when it is issued.
+class BestOffsetPrefetcher : public Prefetcher
+{
+public:
+   uint32_t BestOffset = 1;
+   bool EnabledFlag = true;
+
+   BestOffsetPrefetcher()
+   {
+      Recent.assign(BestOffsetRecentEntries, PrefetchBlockInvalid);
+      Scores.assign(sizeof(Offsets) / sizeof(Offsets[0]), 0);
+   }
+
+   void Train(CacheAddress BlockAddress, bool MissFlag, bool PrefetchHitFlag, vector<CacheAddress> &Candidates)
+   {
+      if (!MissFlag && !PrefetchHitFlag)
+         return;
+
+      if (RecentHit(BlockAddress - Offsets[TestIndex]) && (++Scores[TestIndex] >= BestOffsetScoreMax))
+         EndRound();
+      else if (++TestIndex == Scores.size())
+      {
+         TestIndex = 0;
+         if (++Round >= BestOffsetRoundMax)
+            EndRound();
+      }
+
+      RecentInsert(BlockAddress);
+      if (EnabledFlag)
+         Candidates.push_back(BlockAddress + BestOffset);
+   }
+
+private:
+   static constexpr uint32_t Offsets[] = {1, 2, 3, 4, 5, 6, 8, 9, 10, 12, 15, 16, 18, 20, 24, 25, 27, 30, 32, 36, 40, 45, 48, 50, 54, 60, 64};
+   vector<CacheAddress> Recent;
+   vector<uint32_t> Scores;
+   uint32_t TestIndex = 0;
+   uint32_t Round = 0;
+
+   uint32_t RecentSlot(CacheAddress BlockAddress) const
+   {
+      return ((CacheAddressFold(BlockAddress) * 0x9e3779b1u) >> 16) % BestOffsetRecentEntries;
+   }
+
+   bool RecentHit(CacheAddress BlockAddress) const
+   {
+      return Recent[RecentSlot(BlockAddress)] == BlockAddress;
+   }
+
+   void RecentInsert(CacheAddress BlockAddress)
+   {
+      Recent[RecentSlot(BlockAddress)] = BlockAddress;
+   }
+
+   void EndRound()
+   {
+      uint32_t Best = 0;
+      for (uint32_t Offset = 1; Offset < Scores.size(); Offset++)
+      {
+         if (Scores[Offset] > Scores[Best])
+            Best = Offset;
+      }
+      BestOffset = Offsets[Best];
+      EnabledFlag = Scores[Best] > BestOffsetBadScore;
+      Scores.assign(Scores.size(), 0);
+      TestIndex = 0;
+      Round = 0;
+   }
+};
+
+// An engine from its NAME[:DEGREE] specification into Engine, NULL for "" and "none". Returns
+// what is wrong with the specification, or "" when it is good.
+static inline string ParsePrefetcher(const string &Specification, uint32_t BlockSize, unique_ptr<Prefetcher> &Engine)
+{
+   Engine.reset();
+   if (Specification.empty() || (Specification == "none"))
+      return "";
+   string Name = Specification.substr(0, Specification.find(':'));
+   int32_t Degree = (Name.size() < Specification.size()) ? atoi(Specification.c_str() + Name.size() + 1) : 0;
+   uint32_t DefaultDegree = 1;
+   if (Name == "nextline")
+      Engine.reset(new NextLinePrefetcher());
+   else if (Name == "stride")
+   {
+      Engine.reset(new StridePrefetcher(BlockSize));
+      DefaultDegree = 2;
+   }
+   else if (Name == "ghb")
+   {
+      Engine.reset(new GhbPrefetcher());
+      DefaultDegree = 4;
+   }
+   else if (Name == "bo")
+      Engine.reset(new BestOffsetPrefetcher());
+   if (!Engine || (Degree < 0) || ((Name.size() < Specification.size()) && (Degree == 0)))
+   {
+      Engine.reset();
+      return "Unknown prefetcher " + Specification + " (nextline, stride, ghb or bo, optionally :DEGREE)";
+   }
+   Engine->Specification = Specification;
+   Engine->Degree = (Degree > 0) ? (uint32_t)Degree : DefaultDegree;
+   return "";
+}
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Self-profiling of the simulator's hot paths, built in with -DSIM_PROFILE (make sim_profile).
+// Without it ProfileRegion and ProfileStart expand to nothing.
+//
+// A ProfileRegion(Region) at the top of a function counts the call and its cycles (the TSC on
+// x86-64, steady_clock nanoseconds elsewhere) in thread-local counters. Cycles are kept both
+// inclusive and self, the self cycles leaving out the regions nested inside, so the self column
+// adds up without double counting a level's lookups inside the level above. Worker threads add
+// their counters to the totals when they exit. ProfileStart also opens Linux perf_event counters
+// for the process and its later threads (user-mode cycles, LLC misses and branch misses) where
+// the kernel allows it. At exit the breakdown goes to standard error, so it never mixes with the
+// report on standard output.
+
+#define ProfileTraceDecode 0
+#define ProfileGetTagParameters 1
+#define ProfileCacheMiss 2
+#define ProfilePrefetchMiss 3
+#define ProfileUpdateCacheContents 4
+#define ProfileCacheDirtyBitEviction 5
+#define ProfileUpdatePrefetchContents 6
+#define ProfileRegionCount 7
+
+#ifdef SIM_PROFILE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define ProfileRegion(Region) ProfileTimer ProfileTimerInstance(Region)
+#define ProfileStart() Profiler::Start()
+
+static inline uint64_t ProfileCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct ProfileRegionCounters
+{
+   uint64_t Calls = 0;
+   uint64_t Cycles = 0;
+   uint64_t SelfCycles = 0;
+};
+
+struct ProfileThreadCounters
+{
+   ProfileRegionCounters Regions[ProfileRegionCount];
+   uint64_t NestedCycles = 0; // cycles of the regions nested in the innermost open one so far
+   ~ProfileThreadCounters();
+};
+
+class Profiler
+{
+public:
+   static inline const char *RegionNames[ProfileRegionCount] = {"trace decode", "GetTagParameters", "CacheMiss", "PrefetchMiss",
+                                                               "UpdateCacheContents", "CacheDirtyBitEviction", "UpdatePrefetchContents"};
+   static inline ProfileRegionCounters Totals[ProfileRegionCount];
+   static inline std::mutex TotalsMutex;
+   static inline uint64_t StartCycle = 0;
+   static inline int PerfDescriptors[3] = {-1, -1, -1};
+   static inline const char *PerfNames[3] = {"cycles (user)", "LLC misses", "branch misses"};
+   static inline int PerfError = 0;
+
+   static ProfileThreadCounters &Thread()
+   {
+      static thread_local ProfileThreadCounters Counters;
+      return Counters;
+   }
+
+   static void Merge(ProfileThreadCounters &Counters)
+   {
+      std::lock_guard<std::mutex> Lock(TotalsMutex);
+      for (uint32_t Region = 0; Region < ProfileRegionCount; Region++)
+      {
+         Totals[Region].Calls += Counters.Regions[Region].Calls;
+         Totals[Region].Cycles += Counters.Regions[Region].Cycles;
+         Totals[Region].SelfCycles += Counters.Regions[Region].SelfCycles;
+         Counters.Regions[Region] = ProfileRegionCounters();
+      }
+   }
+
+   static void Start()
+   {
+      StartCycle = ProfileCycles();
+#ifdef __linux__
+      const uint64_t Configurations[3] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+      for (uint32_t Counter = 0; Counter < 3; Counter++)
+      {
+         struct perf_event_attr Attributes;
+         memset(&Attributes, 0, sizeof(Attributes));
+         Attributes.size = sizeof(Attributes);
+         Attributes.type = PERF_TYPE_HARDWARE;
+         Attributes.config = Configurations[Counter];
+         Attributes.inherit = 1;
+         Attributes.exclude_kernel = 1;
+         Attributes.exclude_hv = 1;
+         PerfDescriptors[Counter] = (int)syscall(SYS_perf_event_open, &Attributes, 0, -1, -1, 0);
+         if (PerfDescriptors[Counter] < 0)
+            PerfError = errno;
+      }
+#else
+      PerfError = ENOSYS;
+#endif
+      atexit(Report);
+   }
+
+   // Runs at exit, after the main thread's counters were merged by their destructor
+   static void Report()
+   {
+      uint64_t RunCycles = ProfileCycles() - StartCycle;
+      fprintf(stderr, "===== Simulator profile =====\n");
+      fprintf(stderr, "%-24s %14s %16s %16s %12s %8s\n", "region", "calls", "cycles", "self cycles", "cycles/call", "self %");
+      for (uint32_t Region = 0; Region < ProfileRegionCount; Region++)
+      {
+         const ProfileRegionCounters &Counters = Totals[Region];
+         fprintf(stderr, "%-24s %14llu %16llu %16llu %12.1f %7.2f%%\n", RegionNames[Region], (unsigned long long)Counters.Calls,
+                 (unsigned long long)Counters.Cycles, (unsigned long long)Counters.SelfCycles,
+                 Counters.Calls ? double(Counters.Cycles) / double(Counters.Calls) : 0.0, 100.0 * double(Counters.SelfCycles) / double(RunCycles ? RunCycles : 1));
+      }
+      fprintf(stderr, "%-24s %14s %16llu\n", "run", "", (unsigned long long)RunCycles);
+      for (uint32_t Counter = 0; Counter < 3; Counter++)
+      {
+         uint64_t Value = 0;
+         if ((PerfDescriptors[Counter] >= 0) && (read(PerfDescriptors[Counter], &Value, sizeof(Value)) == (ssize_t)sizeof(Value)))
+            fprintf(stderr, "perf %-19s %14llu\n", PerfNames[Counter], (unsigned long long)Value);
+         else
+            fprintf(stderr, "perf %-19s %14s (%s)\n", PerfNames[Counter], "unavailable", strerror(PerfError ? PerfError : EBADF));
+      }
+   }
+};
+
+inline ProfileThreadCounters::~ProfileThreadCounters()
+{
+   Profiler::Merge(*this);
+}
+
+class ProfileTimer
+{
+public:
+   explicit ProfileTimer(uint32_t InputRegion)
+       : Region(InputRegion), Counters(Profiler::Thread()), OuterNestedCycles(Counters.NestedCycles), Start(ProfileCycles())
+   {
+      Counters.NestedCycles = 0;
+   }
+
+   ~ProfileTimer()
+   {
+      uint64_t Elapsed = ProfileCycles() - Start;
+      ProfileRegionCounters &Totals = Counters.Regions[Region];
+      Totals.Calls += 1;
+      Totals.Cycles += Elapsed;
+      Totals.SelfCycles += Elapsed - Counters.NestedCycles;
+      Counters.NestedCycles = OuterNestedCycles + Elapsed;
+   }
+
+private:
+   uint32_t Region;
+   ProfileThreadCounters &Counters;
+   uint64_t OuterNestedCycles;
+   uint64_t Start;
+};
+
+#else
+
+#define ProfileRegion(Region)
+#define ProfileStart()
+
+#endif
+
+#endif
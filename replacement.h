@@ -0,0 +1,273 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+// Replacement policies for CacheModule. Each policy is a stateless struct whose static members
+// work on the per-set replacement area of the cache; CacheModule's access path is instantiated
+// per policy, so picking the victim or updating recency is a direct (inlinable) call.
+//
+//   Victim(Cache, Set)      way to replace on the next fill; must not change state observably,
+//                           because CacheDirtyBitEviction and UpdateCacheContents both ask for it
+//   Touch(Cache, Set, Way)  demand hit on Way
+//   Insert(Cache, Set, Way) Way was just filled with a new block
+
+struct LruReplacement
+{
+   static uint32_t Victim(CacheModule &Cache, uint32_t SetIndex)
+   {
+      return Cache.CacheSetLruEnds(SetIndex)[LruTail];
+   }
+
+   static void Touch(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      LruListTouch(Cache.CacheSetLruPrev(SetIndex), Cache.CacheSetLruNext(SetIndex), Cache.CacheSetLruEnds(SetIndex), Way);
+   }
+
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      Touch(Cache, SetIndex, Way);
+   }
+};
+
+// Binary tree over a power-of-two ASSOC: node 1 is the root, node n has children 2n and 2n+1,
+// and way w is leaf ASSOC + w. A node bit of 0 sends the victim search left, 1 sends it right.
+struct PlruReplacement
+{
+   static bool TreeBit(uint8_t *Tree, uint32_t Node)
+   {
+      return (Tree[Node >> 3] >> (Node & 7)) & 1;
+   }
+
+   static uint32_t Victim(CacheModule &Cache, uint32_t SetIndex)
+   {
+      uint32_t InvalidWay = Cache.FirstInvalidWay(SetIndex);
+      if (InvalidWay != Cache.ASSOC)
+         return InvalidWay;
+
+      uint8_t *Tree = Cache.CacheSetReplacement(SetIndex);
+      uint32_t Node = 1;
+      while (Node < Cache.ASSOC)
+         Node = 2 * Node + TreeBit(Tree, Node);
+      return Node - Cache.ASSOC;
+   }
+
+   static void Touch(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      uint8_t *Tree = Cache.CacheSetReplacement(SetIndex);
+      for (uint32_t Node = Cache.ASSOC + Way; Node > 1; Node >>= 1)
+      {
+         uint32_t Parent = Node >> 1;
+         if (Node & 1) // right child touched, point the parent left
+            Tree[Parent >> 3] &= ~(1 << (Parent & 7));
+         else
+            Tree[Parent >> 3] |= (1 << (Parent & 7));
+      }
+   }
+
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      Touch(Cache, SetIndex, Way);
+   }
+};
+
+// Static/bimodal/dynamic RRIP with 2-bit re-reference prediction values held per way.
+// The victim search ages the set until some way reaches RripMaxValue; ageing is idempotent
+// once such a way exists, so repeated Victim calls before the fill agree.
+struct RripReplacementBase
+{
+   static uint32_t Victim(CacheModule &Cache, uint32_t SetIndex)
+   {
+      uint32_t InvalidWay = Cache.FirstInvalidWay(SetIndex);
+      if (InvalidWay != Cache.ASSOC)
+         return InvalidWay;
+
+      uint8_t *Rrpv = Cache.CacheSetReplacement(SetIndex);
+      while (true)
+      {
+         for (uint32_t Way = 0; Way < Cache.ASSOC; Way++)
+         {
+            if (Rrpv[Way] >= RripMaxValue)
+               return Way;
+         }
+         for (uint32_t Way = 0; Way < Cache.ASSOC; Way++)
+            Rrpv[Way]++;
+      }
+   }
+
+   static void Touch(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      Cache.CacheSetReplacement(SetIndex)[Way] = 0;
+   }
+
+   static void InsertStatic(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      Cache.CacheSetReplacement(SetIndex)[Way] = RripMaxValue - 1;
+   }
+
+   static void InsertBimodal(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      bool LongInsertion = (Cache.NextReplacementRandom() % BrripLongInsertionPeriod) == 0;
+      Cache.CacheSetReplacement(SetIndex)[Way] = LongInsertion ? RripMaxValue - 1 : RripMaxValue;
+   }
+};
+
+struct SrripReplacement : RripReplacementBase
+{
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      InsertStatic(Cache, SetIndex, Way);
+   }
+};
+
+struct BrripReplacement : RripReplacementBase
+{
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      InsertBimodal(Cache, SetIndex, Way);
+   }
+};
+
+// Set dueling: one group of leader sets always uses SRRIP, another always BRRIP, and a fill
+// (a miss) in either moves the saturating DuelingSelector; follower sets use BRRIP once SRRIP
+// leaders miss more.
+struct DrripReplacement : RripReplacementBase
+{
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      uint32_t Leader = Cache.DuelingLeader(SetIndex);
+      if (Leader == SrripPolicy)
+      {
+         if (Cache.DuelingSelector < DuelingSelectorMax)
+            Cache.DuelingSelector++;
+         InsertStatic(Cache, SetIndex, Way);
+      }
+      else if (Leader == BrripPolicy)
+      {
+         if (Cache.DuelingSelector > 0)
+            Cache.DuelingSelector--;
+         InsertBimodal(Cache, SetIndex, Way);
+      }
+      else if (Cache.DuelingSelector >= DuelingSelectorThreshold)
+         InsertBimodal(Cache, SetIndex, Way);
+      else
+         InsertStatic(Cache, SetIndex, Way);
+   }
+};
+
+// Round-robin insertion pointer per set, used once the set has no invalid way; hits leave it
+// alone
+struct FifoReplacement
+{
+   static uint32_t Victim(CacheModule &Cache, uint32_t SetIndex)
+   {
+      uint32_t InvalidWay = Cache.FirstInvalidWay(SetIndex);
+      if (InvalidWay != Cache.ASSOC)
+         return InvalidWay;
+      return *(uint16_t *)Cache.CacheSetReplacement(SetIndex);
+   }
+
+   static void Touch(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+   }
+
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      uint16_t *InsertionPointer = (uint16_t *)Cache.CacheSetReplacement(SetIndex);
+      if (*InsertionPointer == Way)
+         *InsertionPointer = (Way + 1 == Cache.ASSOC) ? 0 : Way + 1;
+   }
+};
+
+// Victim drawn from the cache's seeded generator; the draw is only consumed by the fill,
+// so every Victim call before it sees the same way
+struct RandomReplacement
+{
+   static uint32_t Victim(CacheModule &Cache, uint32_t SetIndex)
+   {
+      uint32_t InvalidWay = Cache.FirstInvalidWay(SetIndex);
+      if (InvalidWay != Cache.ASSOC)
+         return InvalidWay;
+      return Cache.PeekReplacementRandom() % Cache.ASSOC;
+   }
+
+   static void Touch(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+   }
+
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      Cache.NextReplacementRandom();
+   }
+};
+
+// Run-time dispatch on the cache's own ReplacementPolicy, for the levels of deep hierarchies
+// that are not given a separate instantiation per policy combination
+struct DynamicReplacement
+{
+   static uint32_t Victim(CacheModule &Cache, uint32_t SetIndex)
+   {
+      switch (Cache.ReplacementPolicy)
+      {
+      case PlruPolicy:
+         return PlruReplacement::Victim(Cache, SetIndex);
+      case SrripPolicy:
+      case BrripPolicy:
+      case DrripPolicy:
+         return RripReplacementBase::Victim(Cache, SetIndex);
+      case FifoPolicy:
+         return FifoReplacement::Victim(Cache, SetIndex);
+      case RandomPolicy:
+         return RandomReplacement::Victim(Cache, SetIndex);
+      default:
+         return LruReplacement::Victim(Cache, SetIndex);
+      }
+   }
+
+   static void Touch(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      switch (Cache.ReplacementPolicy)
+      {
+      case PlruPolicy:
+         PlruReplacement::Touch(Cache, SetIndex, Way);
+         break;
+      case SrripPolicy:
+      case BrripPolicy:
+      case DrripPolicy:
+         RripReplacementBase::Touch(Cache, SetIndex, Way);
+         break;
+      case FifoPolicy:
+      case RandomPolicy:
+         break;
+      default:
+         LruReplacement::Touch(Cache, SetIndex, Way);
+      }
+   }
+
+   static void Insert(CacheModule &Cache, uint32_t SetIndex, uint32_t Way)
+   {
+      switch (Cache.ReplacementPolicy)
+      {
+      case PlruPolicy:
+         PlruReplacement::Insert(Cache, SetIndex, Way);
+         break;
+      case SrripPolicy:
+         SrripReplacement::Insert(Cache, SetIndex, Way);
+         break;
+      case BrripPolicy:
+         BrripReplacement::Insert(Cache, SetIndex, Way);
+         break;
+      case DrripPolicy:
+         DrripReplacement::Insert(Cache, SetIndex, Way);
+         break;
+      case FifoPolicy:
+         FifoReplacement::Insert(Cache, SetIndex, Way);
+         break;
+      case RandomPolicy:
+         RandomReplacement::Insert(Cache, SetIndex, Way);
+         break;
+      default:
+         LruReplacement::Insert(Cache, SetIndex, Way);
+      }
+   }
+};
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Machine-readable results for --format=json|csv and the --interval stream. A report is a list
+// of groups of fields. A plain group holds one record; a list group holds one record per level,
+// core or histogram bucket. JSON writes the report as one object on one line: plain groups become
+// objects, list groups arrays of objects, and a named record gets a leading "name" field. CSV
+// flattens the report into one header line and one value line. Columns are the field keys,
+// prefixed with the lowercased record name in list groups (l1_reads, core0_l1d_writes, ...).
+// List groups of unnamed records, such as histograms, only go to JSON.
+
+#define ResultsText 0
+#define ResultsJson 1
+#define ResultsCsv 2
+
+struct ResultField
+{
+   string Key;
+   string Value;
+   bool QuoteFlag; // a string; numbers are written as they are
+};
+
+struct ResultRecord
+{
+   string Name;
+   vector<ResultField> Fields;
+
+   ResultRecord &Integer(const string &Key, uint64_t Value)
+   {
+      Fields.push_back({Key, to_string(Value), false});
+      return *this;
+   }
+
+   // Four decimals, as in the text report; an undefined ratio is written as 0
+   ResultRecord &Fraction(const string &Key, double Value)
+   {
+      char Text[64];
+      snprintf(Text, sizeof(Text), "%.4f", isfinite(Value) ? Value : double(0));
+      Fields.push_back({Key, Text, false});
+      return *this;
+   }
+
+   ResultRecord &Text(const string &Key, const string &Value)
+   {
+      Fields.push_back({Key, Value, true});
+      return *this;
+   }
+};
+
+struct ResultGroup
+{
+   string Name;
+   bool ListFlag;
+   vector<ResultRecord> Records;
+};
+
+class Results
+{
+public:
+   vector<ResultGroup> Groups;
+
+   // The record of a plain group, created on first use
+   ResultRecord &Group(const string &Name)
+   {
+      for (ResultGroup &Existing : Groups)
+      {
+         if (Existing.Name == Name)
+            return Existing.Records[0];
+      }
+      Groups.push_back({Name, false, vector<ResultRecord>(1)});
+      return Groups.back().Records[0];
+   }
+
+   // A new record at the end of a list group
+   ResultRecord &Append(const string &Name, const string &RecordName = "")
+   {
+      ResultGroup *List = NULL;
+      for (ResultGroup &Existing : Groups)
+      {
+         if (Existing.Name == Name)
+            List = &Existing;
+      }
+      if (List == NULL)
+      {
+         Groups.push_back({Name, true, {}});
+         List = &Groups.back();
+      }
+      List->Records.emplace_back();
+      List->Records.back().Name = RecordName;
+      return List->Records.back();
+   }
+
+   void WriteJson(ostream &Output) const
+   {
+      Output << '{';
+      for (uint32_t Group = 0; Group < Groups.size(); Group++)
+      {
+         Output << ((Group == 0) ? "" : ",") << JsonString(Groups[Group].Name) << ':';
+         if (Groups[Group].ListFlag)
+            Output << '[';
+         for (uint32_t Record = 0; Record < Groups[Group].Records.size(); Record++)
+         {
+            const ResultRecord &Values = Groups[Group].Records[Record];
+            Output << ((Record == 0) ? "{" : ",{");
+            if (!Values.Name.empty())
+               Output << "\"name\":" << JsonString(Values.Name) << (Values.Fields.empty() ? "" : ",");
+            for (uint32_t Field = 0; Field < Values.Fields.size(); Field++)
+            {
+               const ResultField &Value = Values.Fields[Field];
+               Output << ((Field == 0) ? "" : ",") << JsonString(Value.Key) << ':' << (Value.QuoteFlag ? JsonString(Value.Value) : Value.Value);
+            }
+            Output << '}';
+         }
+         if (Groups[Group].ListFlag)
+            Output << ']';
+      }
+      Output << '}' << '\n';
+   }
+
+   void WriteCsvHeader(ostream &Output) const
+   {
+      WriteCsvLine(Output, true);
+   }
+
+   void WriteCsvRow(ostream &Output) const
+   {
+      WriteCsvLine(Output, false);
+   }
+
+private:
+   static string JsonString(const string &Value)
+   {
+      string Quoted = "\"";
+      for (char Character : Value)
+      {
+         if ((Character == '"') || (Character == '\\'))
+            Quoted += '\\';
+         if ((unsigned char)Character < 0x20)
+         {
+            char Escape[8];
+            snprintf(Escape, sizeof(Escape), "\\u%04x", (unsigned char)Character);
+            Quoted += Escape;
+         }
+         else
+            Quoted += Character;
+      }
+      return Quoted + '"';
+   }
+
+   static string CsvString(const string &Value)
+   {
+      if (Value.find_first_of(",\"\n") == string::npos)
+         return Value;
+      string Quoted = "\"";
+      for (char Character : Value)
+      {
+         if (Character == '"')
+            Quoted += '"';
+         Quoted += Character;
+      }
+      return Quoted + '"';
+   }
+
+   static string CsvPrefix(const string &RecordName)
+   {
+      string Prefix;
+      for (char Character : RecordName)
+         Prefix += (char)tolower((unsigned char)Character);
+      return Prefix.empty() ? Prefix : Prefix + '_';
+   }
+
+   void WriteCsvLine(ostream &Output, bool HeaderFlag) const
+   {
+      bool InitialFlag = true;
+      for (const ResultGroup &Group : Groups)
+      {
+         for (const ResultRecord &Values : Group.Records)
+         {
+            if (Group.ListFlag && Values.Name.empty())
+               continue;
+            for (const ResultField &Value : Values.Fields)
+            {
+               Output << (InitialFlag ? "" : ",") << (HeaderFlag ? CsvPrefix(Group.ListFlag ? Values.Name : "") + Value.Key : CsvString(Value.Value));
+               InitialFlag = false;
+            }
+         }
+      }
+      Output << '\n';
+   }
+};
+
+#endif
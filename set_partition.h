@@ -0,0 +1,151 @@
+#ifndef SET_PARTITION_H
+#define SET_PARTITION_H
+
+#include "hierarchy.h"
+#include "sweep_scheduler.h"
+#include <memory>
+#include <vector>
+
+// Set-partitioned simulation of a single configuration over several threads. Every level
+// indexes its sets with the bits just above the block offset, so the index bits all levels
+// share sort the blocks into set classes. Every access a reference causes below L1 stays
+// within its class:
+//   - the fill of the missing block
+//   - the write-back of the L1 victim, which shares the L1 set
+// Without stream buffers, prefetcher engines, or replacement draws shared by all sets (random,
+// BRRIP and DRRIP), the classes are independent caches. Each partition simulates the references
+// of its classes, in trace order, on its own copy of the hierarchy. At the end its sets and
+// counters go back into the hierarchy, so the results are those of a sequential run.
+// SweepScheduler decodes the trace once for all partitions, and each batch is grouped by
+// partition once as it is decoded, so a partition reads only its own references.
+
+class SetPartitionedRun
+{
+public:
+   // Whether the classes of Hierarchy are independent, and there are at least two of them
+   static bool Supported(const CacheHierarchy &Hierarchy)
+   {
+      if ((Hierarchy.Cores != NULL) || (Hierarchy.Timing != NULL) || Hierarchy.Sampler.Enabled)
+         return false;
+      for (uint32_t Level = 0; Level < Hierarchy.LevelCount; Level++)
+      {
+         const CacheModule &Cache = *Hierarchy.Levels[Level];
+         if ((Cache.PREF_N > 0) || Cache.PrefetchEngine || (Cache.ReplacementPolicy == RandomPolicy) || (Cache.ReplacementPolicy == BrripPolicy) || (Cache.ReplacementPolicy == DrripPolicy))
+            return false;
+      }
+      return ClassBitCount(Hierarchy) > 0;
+   }
+
+   // Simulates the rest of Trace on Hierarchy over ThreadCount partitions; Hierarchy must be Supported
+   static void Run(TraceReader &Trace, CacheHierarchy &Hierarchy, uint32_t ThreadCount, size_t BatchSize)
+   {
+      SetPartitionedRun Partitioned(Hierarchy, ThreadCount, BatchSize);
+      SweepScheduler::Run(Trace, Partitioned.Partitions.size(), ThreadCount, BatchSize,
+                          [&Partitioned](size_t Slot, const TraceRecord *Records, size_t RecordCount)
+                          { Partitioned.Bucket(Slot, Records, RecordCount); },
+                          [&Partitioned](size_t Partition, size_t Slot, const TraceRecord *, size_t)
+                          { Partitioned.Simulate(Partition, Slot); });
+      Partitioned.Merge();
+   }
+
+private:
+   // A decoded batch with the references of each partition together, each partition's in trace order
+   struct BucketedBatch
+   {
+      vector<TraceRecord> Records;
+      vector<size_t> PartitionStarts; // PartitionCount + 1 offsets into Records
+   };
+
+   CacheHierarchy &Hierarchy;
+   uint32_t BlockOffsetBitCount;
+   CacheAddress ClassMask;
+   vector<uint32_t> ClassPartitions; // partition of each set class, dealt round robin
+   vector<unique_ptr<CacheHierarchy>> Partitions;
+   vector<BucketedBatch> Batches;     // one per SweepScheduler ring slot
+   vector<uint32_t> RecordPartitions; // Bucket's scratch, used only by the decoding thread
+   vector<size_t> PartitionEnds;
+
+   SetPartitionedRun(CacheHierarchy &InputHierarchy, uint32_t ThreadCount, size_t BatchSize)
+       : Hierarchy(InputHierarchy),
+         BlockOffsetBitCount(InputHierarchy.L1.BlockOffsetBitCount),
+         ClassMask(((CacheAddress)1 << ClassBitCount(InputHierarchy)) - 1)
+   {
+      uint32_t PartitionCount = (uint32_t)min<CacheAddress>(ThreadCount, ClassMask + 1);
+      for (CacheAddress Class = 0; Class <= ClassMask; Class++)
+         ClassPartitions.push_back((uint32_t)(Class % PartitionCount));
+
+      // A partition starts from the hierarchy's contents (a restored checkpoint) and zero counters
+      Partitions.resize(PartitionCount);
+      for (unique_ptr<CacheHierarchy> &Part : Partitions)
+      {
+         Part.reset(new CacheHierarchy(Hierarchy.Configuration));
+         for (uint32_t Level = 0; Level < Hierarchy.LevelCount; Level++)
+            Part->Levels[Level]->CacheSets = Hierarchy.Levels[Level]->CacheSets;
+      }
+
+      Batches.resize(SweepRingBatches);
+      for (BucketedBatch &Batch : Batches)
+      {
+         Batch.Records.resize(BatchSize);
+         Batch.PartitionStarts.resize(PartitionCount + 1);
+      }
+      RecordPartitions.resize(BatchSize);
+      PartitionEnds.resize(PartitionCount);
+   }
+
+   // The index bits of the level with the fewest sets
+   static uint32_t ClassBitCount(const CacheHierarchy &Hierarchy)
+   {
+      uint32_t BitCount = Hierarchy.L1.IndexBitCount;
+      for (uint32_t Level = 1; Level < Hierarchy.LevelCount; Level++)
+         BitCount = min(BitCount, Hierarchy.Levels[Level]->IndexBitCount);
+      return BitCount;
+   }
+
+   // Groups a decoded batch by partition into its slot: a stable counting sort on the partition
+   void Bucket(size_t Slot, const TraceRecord *Records, size_t RecordCount)
+   {
+      BucketedBatch &Batch = Batches[Slot];
+      vector<size_t> &Starts = Batch.PartitionStarts;
+      fill(Starts.begin(), Starts.end(), 0);
+      for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+      {
+         uint32_t PartitionIndex = ClassPartitions[(Records[RecordCounter].Address >> BlockOffsetBitCount) & ClassMask];
+         RecordPartitions[RecordCounter] = PartitionIndex;
+         Starts[PartitionIndex + 1]++;
+      }
+      for (size_t PartitionIndex = 0; PartitionIndex < Partitions.size(); PartitionIndex++)
+      {
+         Starts[PartitionIndex + 1] += Starts[PartitionIndex];
+         PartitionEnds[PartitionIndex] = Starts[PartitionIndex];
+      }
+      for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+         Batch.Records[PartitionEnds[RecordPartitions[RecordCounter]]++] = Records[RecordCounter];
+   }
+
+   void Simulate(size_t PartitionIndex, size_t Slot)
+   {
+      const BucketedBatch &Batch = Batches[Slot];
+      size_t Start = Batch.PartitionStarts[PartitionIndex];
+      Partitions[PartitionIndex]->Simulate(Batch.Records.data() + Start, Batch.PartitionStarts[PartitionIndex + 1] - Start);
+   }
+
+   // Each set comes back from the partition owning its class; the counters add up
+   void Merge()
+   {
+      for (uint32_t Level = 0; Level < Hierarchy.LevelCount; Level++)
+      {
+         CacheModule &Cache = *Hierarchy.Levels[Level];
+         for (uint32_t SetIndex = 0; SetIndex < Cache.NumberOfSets; SetIndex++)
+         {
+            const CacheModule &Owner = *Partitions[ClassPartitions[SetIndex & ClassMask]]->Levels[Level];
+            size_t FirstLine = (size_t)SetIndex * Cache.CacheSetLineCount;
+            copy(Owner.CacheSets.begin() + FirstLine, Owner.CacheSets.begin() + FirstLine + Cache.CacheSetLineCount, Cache.CacheSets.begin() + FirstLine);
+         }
+         for (const unique_ptr<CacheHierarchy> &Part : Partitions)
+            Cache.Statistics.Add(Part->Levels[Level]->Statistics);
+      }
+   }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SET_SAMPLING_H
+#define SET_SAMPLING_H
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// Set sampling for --sample. Sets are grouped into classes by the low SampleBitCount bits of
+// the block address, the index bits every level shares, so a sampled class sees all of its
+// traffic at every level. A hashed, seeded choice of classes is simulated, counts are scaled
+// back up by the inverse of the sampled fraction and the spread of the per-class miss rates
+// gives a confidence interval for the miss rates (ratio estimator under simple random sampling
+// of classes without replacement).
+
+#define SampleConfidenceZ 1.96 // 95%
+
+struct SampleClassStatistics
+{
+   uint64_t L1Accesses = 0;
+   uint64_t L1Misses = 0;
+   uint64_t L2Accesses = 0;
+   uint64_t L2Misses = 0;
+};
+
+class SetSampler
+{
+public:
+   bool Enabled = false;
+   uint32_t SampleBitCount = 0;
+   uint32_t ClassMask = 0;
+   uint32_t SampledClassCount = 0;
+   vector<uint8_t> SampledClasses;
+   vector<SampleClassStatistics> ClassStatistics;
+
+   // Samples round(Fraction * classes) of the 2^InputSampleBitCount classes, at least one
+   void Select(uint32_t InputSampleBitCount, double Fraction, uint64_t Seed)
+   {
+      Enabled = true;
+      SampleBitCount = InputSampleBitCount;
+      ClassMask = (1u << SampleBitCount) - 1;
+      uint32_t ClassCount = ClassMask + 1;
+      SampledClassCount = max(1u, min(ClassCount, (uint32_t)llround(Fraction * ClassCount)));
+
+      vector<pair<uint64_t, uint32_t>> Ranking;
+      for (uint32_t Class = 0; Class < ClassCount; Class++)
+         Ranking.push_back(make_pair(Mix(Seed ^ ((uint64_t)Class * 0x9e3779b97f4a7c15ull)), Class));
+      nth_element(Ranking.begin(), Ranking.begin() + (SampledClassCount - 1), Ranking.end());
+      SampledClasses.assign(ClassCount, 0);
+      for (uint32_t Rank = 0; Rank < SampledClassCount; Rank++)
+         SampledClasses[Ranking[Rank].second] = 1;
+      ClassStatistics.assign(ClassCount, SampleClassStatistics());
+   }
+
+   double Scale() const
+   {
+      return double(ClassMask + 1) / double(SampledClassCount);
+   }
+
+   // Half width of the confidence interval of L1 (Level 1) or L2 demand (Level 2) miss rate;
+   // NaN with a single sampled class, 0 when every class is simulated
+   double MissRateHalfWidth(uint32_t Level) const
+   {
+      double Accesses = 0;
+      double Misses = 0;
+      for (uint32_t Class = 0; Class <= ClassMask; Class++)
+      {
+         if (!SampledClasses[Class])
+            continue;
+         Accesses += (Level == 1) ? ClassStatistics[Class].L1Accesses : ClassStatistics[Class].L2Accesses;
+         Misses += (Level == 1) ? ClassStatistics[Class].L1Misses : ClassStatistics[Class].L2Misses;
+      }
+      if (SampledClassCount < 2)
+         return NAN;
+      if (Accesses == 0)
+         return 0;
+
+      double Ratio = Misses / Accesses;
+      double SumOfSquares = 0;
+      for (uint32_t Class = 0; Class <= ClassMask; Class++)
+      {
+         if (!SampledClasses[Class])
+            continue;
+         double ClassAccesses = (Level == 1) ? ClassStatistics[Class].L1Accesses : ClassStatistics[Class].L2Accesses;
+         double ClassMisses = (Level == 1) ? ClassStatistics[Class].L1Misses : ClassStatistics[Class].L2Misses;
+         SumOfSquares += (ClassMisses - Ratio * ClassAccesses) * (ClassMisses - Ratio * ClassAccesses);
+      }
+      double SampleCount = SampledClassCount;
+      double MeanAccesses = Accesses / SampleCount;
+      double FinitePopulation = 1 - SampleCount / double(ClassMask + 1);
+      double Variance = FinitePopulation / SampleCount * (SumOfSquares / (SampleCount - 1)) / (MeanAccesses * MeanAccesses);
+      return SampleConfidenceZ * sqrt(Variance);
+   }
+
+private:
+   // splitmix64 finalizer
+   static uint64_t Mix(uint64_t Value)
+   {
+      Value = (Value ^ (Value >> 30)) * 0xbf58476d1ce4e5b9ull;
+      Value = (Value ^ (Value >> 27)) * 0x94d049bb133111ebull;
+      return Value ^ (Value >> 31);
+   }
+};
+
+#endif
@@ -1,165 +1,937 @@
-#include "sim.h"
+#include "hierarchy.h"
+#include "sweep_scheduler.h"
+#include "set_partition.h"
+#include "stack_distance.h"
+#include "results.h"
 #include <iostream>
 #include <array>
 #include <string>
 #include <fstream>
+#include <string.h>
+#include <memory>
 using namespace std;
 
 string InputTraceFileNameString = "";
-uint32_t InputBlockSize = 0;
-uint32_t InputL1Size = 0;
-uint32_t InputL1Assoc = 0;
-uint32_t InputL2Size = 0;
-uint32_t InputL2Assoc = 0;
-uint32_t InputL1PrefetchN = 0;
-uint32_t InputL1PrefetchM = 0;
-uint32_t InputL2PrefetchN = 0;
-uint32_t InputL2PrefetchM = 0;
+#define TraceBatchSize 65536
+#define SweepBatchSize 8192
 
-int main(int ArgumentCount, char *ArgumentVariables[])
+uint32_t InputL1Policy = LruPolicy;
+uint32_t InputL2Policy = LruPolicy;
+string InputL1Prefetcher = "none";
+string InputL2Prefetcher = "none";
+uint64_t InputReplacementSeed = 1;
+bool InputMapTrace = false;
+uint32_t InputThreadCount = 1;
+bool InputStackDistance = false;
+bool InputStackDistanceCheck = false;
+double InputSampleFraction = 1;
+const char *InputSaveCheckpointFileName = NULL;
+const char *InputRestoreCheckpointFileName = NULL;
+bool InputResetStatistics = false;
+uint64_t InputRecordLimit = 0;
+uint32_t InputCoreCount = 0; // 0 simulates the trace on a single core, ignoring core IDs
+bool InputSplitL1 = false;
+uint32_t InputCoherenceProtocol = CoherenceMesi;
+bool InputTiming = false;
+TimingConfiguration InputTimingConfiguration;
+uint32_t InputFormat = ResultsText;
+bool InputShowContents = true;
+uint64_t InputInterval = 0; // records per --interval report, 0 for none
+const char *InputIntervalFileName = NULL;
+
+// The hierarchy.h checks, exiting on what they find wrong
+uint32_t ParseReplacementPolicy(const char *PolicyName)
 {
-   FILE *TraceFilePointer;
-   char TraceFileReadWrite;
-   uint32_t AddressFromTrace;
-   char *InputTraceFileName;
+   uint32_t Policy;
+   if (!FindReplacementPolicy(PolicyName, Policy))
+   {
+      cout << "Error: Unknown replacement policy " << PolicyName << '\n';
+      exit(EXIT_FAILURE);
+   }
+   return Policy;
+}
 
-   if (ArgumentCount != 9)
+void CheckPrefetcher(const string &Specification)
+{
+   string Error = PrefetcherError(Specification);
+   if (!Error.empty())
    {
-      cout << "Error: Expected 8 command-line arguments but was provided " << ArgumentCount - 1 << '\n';
+      cout << "Error: " << Error << '\n';
       exit(EXIT_FAILURE);
    }
+}
 
-   InputBlockSize = (uint32_t)atoi(ArgumentVariables[1]);
-   InputL1Size = (uint32_t)atoi(ArgumentVariables[2]);
-   InputL1Assoc = (uint32_t)atoi(ArgumentVariables[3]);
-   InputL2Size = (uint32_t)atoi(ArgumentVariables[4]);
-   InputL2Assoc = (uint32_t)atoi(ArgumentVariables[5]);
+void CheckConfiguration(const SimulatorConfiguration &Configuration)
+{
+   string Error = ConfigurationError(Configuration);
+   if (!Error.empty())
+   {
+      cout << "Error: " << Error << '\n';
+      exit(EXIT_FAILURE);
+   }
+}
 
-   if (InputBlockSize % 2)
+// Simulates a batch, exiting on a record of a core the hierarchy does not simulate
+void SimulateTraceRecords(CacheHierarchy &Hierarchy, const TraceRecord *Records, size_t RecordCount)
+{
+   size_t RecordsSimulated = Hierarchy.Simulate(Records, RecordCount);
+   if (RecordsSimulated < RecordCount)
    {
-      cout << "Error: Input Block Size not a power of 2 " << InputBlockSize << '\n';
+      cout << "Error: Trace record for core " << Records[RecordsSimulated].Core << " but only " << Hierarchy.Configuration.CoreCount << " cores are simulated" << '\n';
       exit(EXIT_FAILURE);
    }
+}
 
-   if (InputL2Size == 0)
+// The command-line options every simulated hierarchy shares
+void ApplyCommandLineOptions(SimulatorConfiguration &Configuration)
+{
+   Configuration.L1Prefetcher = InputL1Prefetcher;
+   Configuration.L2Prefetcher = InputL2Prefetcher;
+   Configuration.ReplacementSeed = InputReplacementSeed;
+   Configuration.SampleFraction = InputSampleFraction;
+   Configuration.CoreCount = InputCoreCount;
+   Configuration.SplitL1 = InputSplitL1;
+   Configuration.CoherenceProtocol = InputCoherenceProtocol;
+   Configuration.TimingFlag = InputTiming;
+   Configuration.Timing = InputTimingConfiguration;
+}
+
+void CacheSimulatorFinalData(CacheModule &, CacheModule &);
+void CacheSimulatorLevelsData(const CacheHierarchy &);
+void CacheSimulatorCoresData(const CacheHierarchy &);
+void CacheSimulatorTimingData(const CacheHierarchy &);
+void CacheSimulatorPrefetcherData(const CacheHierarchy &);
+void CacheSimulatorSamplingData(const SetSampler &);
+Results CacheSimulatorResults(const CacheHierarchy &);
+
+// Expands one sweep field: a comma separated list of values or A..B ranges, where a range
+// doubles from A up to B (1024..8192 is 1024,2048,4096,8192)
+vector<uint32_t> ParseSweepField(const string &Field, uint32_t LineNumber)
+{
+   vector<uint32_t> Values;
+   stringstream FieldStream(Field);
+   string Item;
+   while (getline(FieldStream, Item, ','))
    {
-      InputL1PrefetchN = (uint32_t)atoi(ArgumentVariables[6]);
-      InputL1PrefetchM = (uint32_t)atoi(ArgumentVariables[7]);
+      size_t RangePosition = Item.find("..");
+      char *End;
+      uint32_t First = (uint32_t)strtoul(Item.c_str(), &End, 0);
+      if ((End == Item.c_str()) || ((RangePosition == string::npos) ? (*End != '\0') : (End != Item.c_str() + RangePosition)))
+      {
+         cout << "Error: Bad sweep value " << Item << " on line " << LineNumber << '\n';
+         exit(EXIT_FAILURE);
+      }
+      if (RangePosition == string::npos)
+      {
+         Values.push_back(First);
+         continue;
+      }
+
+      const char *LastText = Item.c_str() + RangePosition + 2;
+      uint32_t Last = (uint32_t)strtoul(LastText, &End, 0);
+      if ((End == LastText) || (*End != '\0') || (First == 0) || (Last < First))
+      {
+         cout << "Error: Bad sweep range " << Item << " on line " << LineNumber << '\n';
+         exit(EXIT_FAILURE);
+      }
+      for (uint64_t Value = First; Value <= Last; Value *= 2)
+         Values.push_back((uint32_t)Value);
    }
-   else
+   return Values;
+}
+
+// Reads a sweep file. Each non-blank line not starting with # holds
+//   BLOCKSIZE L1_SIZE L1_ASSOC L2_SIZE L2_ASSOC PREF_N PREF_M [L1_POLICY [L2_POLICY]]
+// where every numeric field goes through ParseSweepField and the policy fields are comma
+// separated policy names (defaulting to --l1-policy/--l2-policy); a line contributes the
+// cross product of its fields.
+vector<SimulatorConfiguration> ReadSweepConfigurations(const char *SweepFileName)
+{
+   ifstream SweepFile(SweepFileName);
+   if (!SweepFile)
    {
-      InputL2PrefetchN = (uint32_t)atoi(ArgumentVariables[6]);
-      InputL2PrefetchM = (uint32_t)atoi(ArgumentVariables[7]);
+      cout << "Error: Cannot open sweep file " << SweepFileName << '\n';
+      exit(EXIT_FAILURE);
    }
-   InputTraceFileName = ArgumentVariables[8];
-   InputTraceFileNameString = ArgumentVariables[8];
 
-   bool ReadWriteCacheSubroutine(uint32_t, bool, CacheModule &, CacheModule &, CacheModule &);
-   void CacheSimulatorFinalData(CacheModule, CacheModule);
+   vector<SimulatorConfiguration> Configurations;
+   string Line;
+   uint32_t LineNumber = 0;
+   while (getline(SweepFile, Line))
+   {
+      LineNumber++;
+      stringstream LineStream(Line);
+      vector<string> Fields;
+      string Field;
+      while (LineStream >> Field)
+         Fields.push_back(Field);
+      if (Fields.empty() || (Fields[0][0] == '#'))
+         continue;
+      if ((Fields.size() < 7) || (Fields.size() > 9))
+      {
+         cout << "Error: Expected 7 to 9 sweep fields but line " << LineNumber << " has " << Fields.size() << '\n';
+         exit(EXIT_FAILURE);
+      }
 
-   CacheModule L1(InputBlockSize, InputL1Size, InputL1Assoc, InputL1PrefetchN, InputL1PrefetchM);
-   CacheModule L2(InputBlockSize, InputL2Size, InputL2Assoc, InputL2PrefetchN, InputL2PrefetchM);
-   CacheModule MEMORY(InputBlockSize, 0, 0, 0, 0);
+      vector<vector<uint32_t>> Values;
+      for (uint32_t FieldCounter = 0; FieldCounter < 7; FieldCounter++)
+         Values.push_back(ParseSweepField(Fields[FieldCounter], LineNumber));
+      for (uint32_t FieldCounter = 7; FieldCounter < 9; FieldCounter++)
+      {
+         vector<uint32_t> Policies;
+         if (FieldCounter < Fields.size())
+         {
+            stringstream PolicyStream(Fields[FieldCounter]);
+            string PolicyName;
+            while (getline(PolicyStream, PolicyName, ','))
+               Policies.push_back(ParseReplacementPolicy(PolicyName.c_str()));
+         }
+         else
+            Policies.push_back((FieldCounter == 7) ? InputL1Policy : InputL2Policy);
+         Values.push_back(Policies);
+      }
 
-   TraceFilePointer = fopen(InputTraceFileName, "r");
-   if (TraceFilePointer == (FILE *)NULL)
+      vector<size_t> Choice(Values.size(), 0);
+      bool Done = false;
+      for (const vector<uint32_t> &FieldValues : Values)
+         Done |= FieldValues.empty();
+      while (!Done)
+      {
+         SimulatorConfiguration Configuration = {Values[0][Choice[0]], Values[1][Choice[1]], Values[2][Choice[2]], Values[3][Choice[3]], Values[4][Choice[4]], Values[5][Choice[5]], Values[6][Choice[6]], Values[7][Choice[7]], Values[8][Choice[8]]};
+         CheckConfiguration(Configuration);
+         Configurations.push_back(Configuration);
+
+         // Odometer over the fields, last field fastest
+         size_t FieldCounter = Values.size();
+         while ((FieldCounter > 0) && (++Choice[FieldCounter - 1] == Values[FieldCounter - 1].size()))
+            Choice[--FieldCounter] = 0;
+         Done = (FieldCounter == 0);
+      }
+   }
+   return Configurations;
+}
+
+// Reads a --hierarchy file: a "blocksize BLOCKSIZE" line and then one line per level, top first,
+//   level NAME SIZE ASSOC [PREF_N PREF_M [POLICY]]
+// Blank lines and lines starting with # are skipped. Every level below the top one is filled
+// from the one under it and takes its write-backs; the last level is backed by memory.
+SimulatorConfiguration ReadHierarchyConfiguration(const char *HierarchyFileName)
+{
+   ifstream HierarchyFile(HierarchyFileName);
+   if (!HierarchyFile)
+   {
+      cout << "Error: Cannot open hierarchy file " << HierarchyFileName << '\n';
       exit(EXIT_FAILURE);
+   }
 
-   while (fscanf(TraceFilePointer, "%c %x\n", &TraceFileReadWrite, &AddressFromTrace) == 2)
+   uint32_t BlockSize = 0;
+   vector<LevelConfiguration> Levels;
+   string Line;
+   uint32_t LineNumber = 0;
+   while (getline(HierarchyFile, Line))
    {
-      if (TraceFileReadWrite == 'r')
-         ReadWriteCacheSubroutine(AddressFromTrace, false, L1, L2, MEMORY);
-      else if (TraceFileReadWrite == 'w')
-         ReadWriteCacheSubroutine(AddressFromTrace, true, L1, L2, MEMORY);
+      LineNumber++;
+      stringstream LineStream(Line);
+      vector<string> Fields;
+      string Field;
+      while (LineStream >> Field)
+         Fields.push_back(Field);
+      if (Fields.empty() || (Fields[0][0] == '#'))
+         continue;
+
+      if ((Fields[0] == "blocksize") && (Fields.size() == 2))
+         BlockSize = (uint32_t)atoi(Fields[1].c_str());
+      else if ((Fields[0] == "level") && ((Fields.size() == 4) || (Fields.size() == 6) || (Fields.size() == 7) || (Fields.size() == 8)))
+      {
+         LevelConfiguration Level = {Fields[1], (uint32_t)atoi(Fields[2].c_str()), (uint32_t)atoi(Fields[3].c_str()), 0, 0, LruPolicy};
+         if (Fields.size() >= 6)
+         {
+            Level.PrefetchN = (uint32_t)atoi(Fields[4].c_str());
+            Level.PrefetchM = (uint32_t)atoi(Fields[5].c_str());
+         }
+         Level.Policy = (Fields.size() >= 7) ? ParseReplacementPolicy(Fields[6].c_str()) : (Levels.empty() ? InputL1Policy : InputL2Policy);
+         Level.Prefetcher = (Fields.size() == 8) ? Fields[7] : (Levels.empty() ? InputL1Prefetcher : InputL2Prefetcher);
+         CheckPrefetcher(Level.Prefetcher);
+         if ((Level.Size == 0) || (Level.Assoc == 0))
+         {
+            cout << "Error: Level " << Level.Name << " on line " << LineNumber << " needs a non-zero SIZE and ASSOC" << '\n';
+            exit(EXIT_FAILURE);
+         }
+         Levels.push_back(Level);
+      }
       else
       {
-         cout << "Error: Unknown request type" << TraceFileReadWrite;
+         cout << "Error: Bad hierarchy line " << LineNumber << ": " << Line << '\n';
          exit(EXIT_FAILURE);
       }
    }
 
-   CacheSimulatorFinalData(L1, L2);
-   return (0);
+   string Error;
+   SimulatorConfiguration Configuration = LevelsConfiguration(BlockSize, Levels, Error);
+   if (!Error.empty())
+   {
+      cout << "Error: " << Error << '\n';
+      exit(EXIT_FAILURE);
+   }
+   return Configuration;
 }
 
-bool ReadWriteCacheSubroutine(uint32_t TagAddress, bool WriteFlag, CacheModule &L1, CacheModule &L2, CacheModule &MEMORY)
+// A --timing file: "latency NAME CYCLES" lines for the levels by name and "SETTING VALUE" lines
+// for the memory system, e.g. "dram_banks 8"; anything not given keeps its default
+TimingConfiguration ReadTimingConfiguration(const char *TimingFileName)
 {
-   if (WriteFlag)
-      L1.WriteCount += 1;
-   else
-      L1.ReadCount += 1;
+   ifstream TimingFile(TimingFileName);
+   if (!TimingFile)
+   {
+      cout << "Error: Cannot open timing file " << TimingFileName << '\n';
+      exit(EXIT_FAILURE);
+   }
 
-   if (L1.CacheMiss(TagAddress))
+   TimingConfiguration Configuration;
+   vector<pair<string, uint32_t *>> Settings = {
+       {"mshrs", &Configuration.MshrCount},
+       {"writeback_buffer", &Configuration.WriteBackBufferEntries},
+       {"dram_banks", &Configuration.DramBanks},
+       {"dram_row_size", &Configuration.DramRowSize},
+       {"dram_tcas", &Configuration.DramTcas},
+       {"dram_trcd", &Configuration.DramTrcd},
+       {"dram_trp", &Configuration.DramTrp},
+       {"dram_bus_bytes", &Configuration.DramBusBytes},
+       {"dram_controller", &Configuration.DramController},
+       {"interval", &Configuration.Interval}};
+   string Line;
+   uint32_t LineNumber = 0;
+   while (getline(TimingFile, Line))
    {
-      if (L1.PrefetchMiss(TagAddress))
+      LineNumber++;
+      stringstream LineStream(Line);
+      vector<string> Fields;
+      string Field;
+      while (LineStream >> Field)
+         Fields.push_back(Field);
+      if (Fields.empty() || (Fields[0][0] == '#'))
+         continue;
+
+      bool KnownFlag = false;
+      if ((Fields[0] == "latency") && (Fields.size() == 3))
       {
-         if (WriteFlag)
-            L1.WriteMissCount += 1;
-         else
-            L1.ReadMissCount += 1;
+         Configuration.Latencies.push_back(make_pair(Fields[1], (uint32_t)atoi(Fields[2].c_str())));
+         KnownFlag = true;
+      }
+      else if ((Fields[0] == "clock_ghz") && (Fields.size() == 2))
+      {
+         Configuration.ClockGhz = atof(Fields[1].c_str());
+         KnownFlag = Configuration.ClockGhz > 0;
+      }
+      for (const pair<string, uint32_t *> &Setting : Settings)
+      {
+         if ((Fields[0] == Setting.first) && (Fields.size() == 2))
+         {
+            *Setting.second = (uint32_t)atoi(Fields[1].c_str());
+            KnownFlag = true;
+         }
+      }
+      if (!KnownFlag)
+      {
+         cout << "Error: Bad timing line " << LineNumber << ": " << Line << '\n';
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   return Configuration; // checked with the hierarchy by ConfigurationError
+}
+
+// Sweep output: one CSV row per configuration, carrying the same measurements as the text report
+void CacheSimulatorSweepHeader()
+{
+   cout << "blocksize,l1_size,l1_assoc,l2_size,l2_assoc,pref_n,pref_m,l1_policy,l2_policy,"
+        << "l1_reads,l1_read_misses,l1_writes,l1_write_misses,l1_miss_rate,l1_writebacks,l1_prefetches,"
+        << "l2_reads,l2_read_misses,l2_prefetch_reads,l2_prefetch_read_misses,l2_writes,l2_write_misses,l2_miss_rate,l2_writebacks,l2_prefetches,"
+        << "memory_traffic" << ((InputSampleFraction < 1) ? ",sampled_fraction,l1_miss_rate_ci,l2_miss_rate_ci" : "") << endl;
+}
+
+void CacheSimulatorSweepRow(const CacheHierarchy &Hierarchy)
+{
+   const SimulatorConfiguration &Configuration = Hierarchy.Configuration;
+   const CacheModule &L1 = Hierarchy.L1;
+   const CacheModule &L2 = Hierarchy.L2;
+   cout << Configuration.BlockSize << ',' << Configuration.L1Size << ',' << Configuration.L1Assoc << ',' << Configuration.L2Size << ',' << Configuration.L2Assoc << ','
+        << Configuration.PrefetchN << ',' << Configuration.PrefetchM << ',' << ReplacementPolicyNames[Configuration.L1Policy] << ',' << ReplacementPolicyNames[Configuration.L2Policy] << ','
+        << L1.Statistics.ReadCount << ',' << L1.Statistics.ReadMissCount << ',' << L1.Statistics.WriteCount << ',' << L1.Statistics.WriteMissCount << ','
+        << fixed << setprecision(4) << (double(L1.Statistics.ReadMissCount + L1.Statistics.WriteMissCount) / double(L1.Statistics.ReadCount + L1.Statistics.WriteCount)) << ','
+        << L1.Statistics.WriteBackCount << ',' << L1.Statistics.PrefetchesCount << ','
+        << L2.Statistics.ReadCount << ',' << L2.Statistics.ReadMissCount << ',' << L2.Statistics.ReadPrefetchCount << ',' << L2.Statistics.ReadMissPrefetchCount << ',' << L2.Statistics.WriteCount << ',' << L2.Statistics.WriteMissCount << ','
+        << ((L2.Statistics.ReadCount == 0) ? double(0) : (double(L2.Statistics.ReadMissCount) / double(L2.Statistics.ReadCount))) << ','
+        << L2.Statistics.WriteBackCount << ',' << L2.Statistics.PrefetchesCount << ',' << (L1.Statistics.MemoryTraffic + L2.Statistics.MemoryTraffic);
+   if (Hierarchy.Sampler.Enabled)
+      cout << ',' << 1 / Hierarchy.Sampler.Scale() << ',' << Hierarchy.Sampler.MissRateHalfWidth(1) << ',' << Hierarchy.Sampler.MissRateHalfWidth(2);
+   cout << '\n';
+}
+
+// Adds up the private caches of --cores, the top level of the report
+void SumPrivateCaches(const CoherentCores &Cores, CacheModule &Total, CoherenceStatistics &TotalStatistics)
+{
+   for (const vector<PrivateCache> *Caches : {&Cores.DataCaches, &Cores.InstructionCaches})
+   {
+      for (const PrivateCache &Private : *Caches)
+      {
+         const CacheModule &Cache = *Private.Cache;
+         Total.Statistics.Add(Cache.Statistics);
+         TotalStatistics.Add(Private.Statistics);
+      }
+   }
+}
+
+// A snapshot of every level's counters for --interval
+vector<CacheStatistics> SnapshotLevelStatistics(const CacheHierarchy &Hierarchy)
+{
+   vector<CacheStatistics> Snapshot;
+   for (uint32_t Level = 0; Level < Hierarchy.LevelCount; Level++)
+      Snapshot.push_back(Hierarchy.LevelStatistics(Level));
+   return Snapshot;
+}
+
+// --interval=N: after every N trace records (and for the remainder at the end), the change in
+// each level's counters since the previous interval, as CSV rows under one header or as JSON
+// lines with --format=json. Sampled runs are scaled up like the final counts.
+class IntervalReporter
+{
+public:
+   IntervalReporter(const CacheHierarchy &InputHierarchy, uint64_t InputLength, uint64_t RecordStart, ostream &InputOutput)
+       : Hierarchy(InputHierarchy), Length(InputLength), Output(InputOutput), IntervalStart(RecordStart), Records(RecordStart)
+   {
+      Previous = SnapshotLevelStatistics(Hierarchy);
+      if (Hierarchy.Timing != NULL)
+      {
+         PreviousCycle = Hierarchy.Timing->Cycle;
+         PreviousAccessCount = Hierarchy.Timing->AccessCount;
+      }
+   }
+
+   uint64_t RemainingRecords() const
+   {
+      return Length - (Records - IntervalStart);
+   }
+
+   void Advance(uint64_t RecordCount)
+   {
+      Records += RecordCount;
+      if (Records - IntervalStart == Length)
+         Report();
+   }
+
+   void Finish()
+   {
+      if (Records > IntervalStart)
+         Report();
+      Output.flush();
+   }
+
+private:
+   const CacheHierarchy &Hierarchy;
+   uint64_t Length;
+   ostream &Output;
+   uint64_t IntervalStart;
+   uint64_t Records;
+   uint32_t IntervalCount = 0;
+   vector<CacheStatistics> Previous;
+   uint64_t PreviousCycle = 0;
+   uint64_t PreviousAccessCount = 0;
+
+   void Report()
+   {
+      vector<CacheStatistics> Current = SnapshotLevelStatistics(Hierarchy);
+      vector<LevelConfiguration> Levels = ConfigurationLevels(Hierarchy.Configuration);
+      double Scale = Hierarchy.Sampler.Enabled ? Hierarchy.Sampler.Scale() : 1;
+      vector<CacheStatistics> Changes(Current.size());
+      uint64_t MemoryTraffic = 0;
+      for (uint32_t Level = 0; Level < Current.size(); Level++)
+      {
+         Changes[Level] = Current[Level].Since(Previous[Level]);
+         MemoryTraffic += Changes[Level].MemoryTraffic;
+      }
+
+      Results Interval;
+      Interval.Group("interval")
+          .Integer("interval", IntervalCount)
+          .Integer("record_start", IntervalStart)
+          .Integer("record_end", Records)
+          .Integer("memory_traffic", llround(MemoryTraffic * Scale));
+      if (Hierarchy.Timing != NULL)
+      {
+         uint64_t Cycles = Hierarchy.Timing->Cycle - PreviousCycle;
+         Interval.Group("interval")
+             .Integer("cycles", Cycles)
+             .Fraction("average_access_time", double(Cycles) / double(Hierarchy.Timing->AccessCount - PreviousAccessCount));
+         PreviousCycle = Hierarchy.Timing->Cycle;
+         PreviousAccessCount = Hierarchy.Timing->AccessCount;
+      }
+      for (uint32_t Level = 0; Level < Current.size(); Level++)
+      {
+         // As in the report, the top level counts all its accesses and the lower levels only demand reads
+         uint64_t Accesses = Changes[Level].DemandAccesses(Level == 0);
+         uint64_t Misses = Changes[Level].DemandMisses(Level == 0);
+         Interval.Append("levels", Levels[Level].Name)
+             .Integer("accesses", llround(Accesses * Scale))
+             .Integer("misses", llround(Misses * Scale))
+             .Fraction("miss_rate", double(Misses) / double(Accesses))
+             .Integer("writebacks", llround(Changes[Level].WriteBackCount * Scale))
+             .Integer("prefetches", llround(Changes[Level].PrefetchesCount * Scale));
+      }
+
+      if (InputFormat == ResultsJson)
+         Interval.WriteJson(Output);
+      else
+      {
+         if (IntervalCount == 0)
+            Interval.WriteCsvHeader(Output);
+         Interval.WriteCsvRow(Output);
+      }
+      Previous = Current;
+      IntervalStart = Records;
+      IntervalCount++;
+   }
+};
+
+// --stack-distance: LRU miss ratio curve over every ASSOC for one BLOCKSIZE and number of sets.
+// Rows are the ASSOC values where the miss count changes. --mrc-check also runs CacheModule at
+// the power of 2 ASSOC points up to StackDistanceCheckMaxAssoc and compares the miss counts.
+#define StackDistanceCheckMaxAssoc 256
+
+void StackDistanceAnalysis(uint32_t BlockSize, uint32_t SetCount, TraceReader &Trace)
+{
+   if ((BlockSize == 0) || (BlockSize & (BlockSize - 1)) || (SetCount == 0) || (SetCount & (SetCount - 1)))
+   {
+      cout << "Error: BLOCKSIZE and SETS must be powers of 2" << '\n';
+      exit(EXIT_FAILURE);
+   }
+
+   StackDistanceAnalyzer Analyzer(BlockSize, SetCount);
+   vector<unique_ptr<CacheHierarchy>> CheckHierarchies;
+   for (uint32_t Assoc = 1; Assoc <= StackDistanceCheckMaxAssoc; Assoc *= 2)
+   {
+      SimulatorConfiguration Configuration = {BlockSize, SetCount * Assoc * BlockSize, Assoc, 0, 0, 0, 0, LruPolicy, LruPolicy};
+      ApplyCommandLineOptions(Configuration);
+      CheckConfiguration(Configuration); // the options are checked even without --mrc-check
+      if (!InputStackDistanceCheck)
+         break;
+      CheckHierarchies.emplace_back(new CacheHierarchy(Configuration));
+   }
+
+   vector<TraceRecord> TraceRecords(TraceBatchSize);
+   size_t RecordCount;
+   while ((RecordCount = Trace.ReadRecords(TraceRecords.data(), TraceBatchSize)) > 0)
+   {
+      for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+         Analyzer.Access(TraceRecords[RecordCounter].Address, TraceRecords[RecordCounter].WriteFlag);
+      for (unique_ptr<CacheHierarchy> &Hierarchy : CheckHierarchies)
+         Hierarchy->Simulate(TraceRecords.data(), RecordCount);
+   }
+
+   cout << "===== Stack distance configuration =====" << endl;
+   cout << "BLOCKSIZE:  " << to_string(BlockSize) << endl;
+   cout << "SETS:       " << to_string(SetCount) << endl;
+   cout << "trace_file: " + InputTraceFileNameString << endl;
+   cout << "===== Miss ratio curve =====" << endl;
+   cout << "assoc,size,read_misses,write_misses,miss_rate" << endl;
+   // Misses at ASSOC + 1 are the misses at ASSOC less the accesses at distance ASSOC, which
+   // only hit from ASSOC + 1 ways on
+   uint64_t AccessCount = Analyzer.ReadCount + Analyzer.WriteCount;
+   uint64_t ReadMisses = Analyzer.ReadMisses(1);
+   uint64_t WriteMisses = Analyzer.WriteMisses(1);
+   bool Changed = true;
+   vector<pair<uint64_t, uint64_t>> CurveMisses(StackDistanceCheckMaxAssoc + 1);
+   for (uint32_t Assoc = 1; Assoc <= StackDistanceCheckMaxAssoc; Assoc++)
+      CurveMisses[Assoc] = make_pair(Analyzer.ReadMisses(Analyzer.MaxUsefulAssoc()), Analyzer.WriteMisses(Analyzer.MaxUsefulAssoc()));
+   for (uint32_t Assoc = 1; Assoc <= Analyzer.MaxUsefulAssoc(); Assoc++)
+   {
+      if (Assoc <= StackDistanceCheckMaxAssoc)
+         CurveMisses[Assoc] = make_pair(ReadMisses, WriteMisses);
+      uint64_t ReadHits = (Assoc < Analyzer.ReadDistanceCount.size()) ? Analyzer.ReadDistanceCount[Assoc] : 0;
+      uint64_t WriteHits = (Assoc < Analyzer.WriteDistanceCount.size()) ? Analyzer.WriteDistanceCount[Assoc] : 0;
+      if (Changed)
+         cout << Assoc << ',' << (uint64_t)SetCount * Assoc * BlockSize << ',' << ReadMisses << ',' << WriteMisses << ','
+              << fixed << setprecision(4) << (double(ReadMisses + WriteMisses) / double(AccessCount)) << '\n';
+      ReadMisses -= ReadHits;
+      WriteMisses -= WriteHits;
+      Changed = (ReadHits + WriteHits) > 0;
+   }
+
+   for (unique_ptr<CacheHierarchy> &Hierarchy : CheckHierarchies)
+   {
+      uint32_t Assoc = Hierarchy->Configuration.L1Assoc;
+      if ((Hierarchy->L1.Statistics.ReadMissCount != CurveMisses[Assoc].first) || (Hierarchy->L1.Statistics.WriteMissCount != CurveMisses[Assoc].second))
+      {
+         cout << "Error: ASSOC " << Assoc << " CacheModule misses " << Hierarchy->L1.Statistics.ReadMissCount << '/' << Hierarchy->L1.Statistics.WriteMissCount
+              << " but stack distance misses " << CurveMisses[Assoc].first << '/' << CurveMisses[Assoc].second << '\n';
+         exit(EXIT_FAILURE);
+      }
+   }
+   if (InputStackDistanceCheck)
+      cout << "mrc check: CacheModule agrees for ASSOC 1.." << StackDistanceCheckMaxAssoc << " (powers of 2)" << endl;
+}
+
+// --save-checkpoint: the state of every level of a single configuration and how many trace
+// records produced it
+void SaveCheckpoint(const char *CheckpointFileName, CacheHierarchy &Hierarchy, uint64_t TraceOffset)
+{
+   CheckpointWriter Checkpoint;
+   Checkpoint.PutBytes(CheckpointMagic, CheckpointMagicSize);
+   Checkpoint.Put((uint32_t)CheckpointVersion);
+   Checkpoint.Put((uint32_t)Hierarchy.Levels.size());
+   Checkpoint.Put(TraceOffset);
+   for (unique_ptr<CacheModule> &Level : Hierarchy.Levels)
+      Level->SaveCheckpoint(Checkpoint);
+   if (!Checkpoint.Write(CheckpointFileName))
+   {
+      cout << "Error: Cannot write checkpoint " << CheckpointFileName << '\n';
+      exit(EXIT_FAILURE);
+   }
+}
+
+// --restore-checkpoint: every hierarchy, all configurations of a sweep included, resumes from the
+// same mapped checkpoint; returns the trace offset to resume at
+uint64_t RestoreCheckpoint(const char *CheckpointFileName, vector<unique_ptr<CacheHierarchy>> &Hierarchies)
+{
+   CheckpointReader Checkpoint;
+   if (!Checkpoint.Open(CheckpointFileName))
+   {
+      cout << "Error: Cannot open checkpoint " << CheckpointFileName << '\n';
+      exit(EXIT_FAILURE);
+   }
+   bool MagicMatches = memcmp(Checkpoint.GetBytes(CheckpointMagicSize), CheckpointMagic, CheckpointMagicSize) == 0;
+   uint32_t Version = Checkpoint.Get<uint32_t>();
+   uint32_t LevelCount = Checkpoint.Get<uint32_t>();
+   if (!MagicMatches || (Version != CheckpointVersion))
+   {
+      cout << "Error: " << CheckpointFileName << " is not a version " << CheckpointVersion << " checkpoint of " << MaxAddressBitSize << "-bit addresses" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   uint64_t TraceOffset = Checkpoint.Get<uint64_t>();
+
+   size_t SectionStart = Checkpoint.Position;
+   for (unique_ptr<CacheHierarchy> &Hierarchy : Hierarchies)
+   {
+      if (LevelCount != Hierarchy->Levels.size())
+      {
+         cout << "Error: Checkpoint has " << LevelCount << " cache levels but the hierarchy has " << Hierarchy->Levels.size() << '\n';
+         exit(EXIT_FAILURE);
+      }
+      Checkpoint.Position = SectionStart;
+      for (unique_ptr<CacheModule> &Level : Hierarchy->Levels)
+      {
+         Level->LoadCheckpoint(Checkpoint);
+         if (InputResetStatistics)
+            Level->ResetStatistics();
+      }
+   }
+   return TraceOffset;
+}
+
+int main(int ArgumentCount, char *ArgumentVariables[])
+{
+   char *InputTraceFileName;
+   const char *InputSweepFileName = NULL;
+   const char *InputHierarchyFileName = NULL;
+   vector<char *> PositionalArguments;
+   ProfileStart();
 
-         if (L2.SIZE == 0)
+   // Options (--name=value, or --name for flags) may appear anywhere; everything else is positional
+   for (int ArgumentCounter = 1; ArgumentCounter < ArgumentCount; ArgumentCounter++)
+   {
+      const char *Argument = ArgumentVariables[ArgumentCounter];
+      if (strncmp(Argument, "--l1-policy=", 12) == 0)
+         InputL1Policy = ParseReplacementPolicy(Argument + 12);
+      else if (strncmp(Argument, "--l2-policy=", 12) == 0)
+         InputL2Policy = ParseReplacementPolicy(Argument + 12);
+      else if (strncmp(Argument, "--l1-prefetcher=", 16) == 0)
+      {
+         InputL1Prefetcher = Argument + 16;
+         CheckPrefetcher(InputL1Prefetcher);
+      }
+      else if (strncmp(Argument, "--l2-prefetcher=", 16) == 0)
+      {
+         InputL2Prefetcher = Argument + 16;
+         CheckPrefetcher(InputL2Prefetcher);
+      }
+      else if (strncmp(Argument, "--seed=", 7) == 0)
+         InputReplacementSeed = strtoull(Argument + 7, NULL, 0);
+      else if (strcmp(Argument, "--mmap") == 0)
+         InputMapTrace = true;
+      else if (strncmp(Argument, "--sweep=", 8) == 0)
+         InputSweepFileName = Argument + 8;
+      else if (strncmp(Argument, "--hierarchy=", 12) == 0)
+         InputHierarchyFileName = Argument + 12;
+      else if (strncmp(Argument, "--sample=", 9) == 0)
+         InputSampleFraction = atof(Argument + 9);
+      else if (strncmp(Argument, "--save-checkpoint=", 18) == 0)
+         InputSaveCheckpointFileName = Argument + 18;
+      else if (strncmp(Argument, "--restore-checkpoint=", 21) == 0)
+         InputRestoreCheckpointFileName = Argument + 21;
+      else if (strcmp(Argument, "--reset-stats") == 0)
+         InputResetStatistics = true;
+      else if (strncmp(Argument, "--records=", 10) == 0)
+         InputRecordLimit = strtoull(Argument + 10, NULL, 0);
+      else if (strncmp(Argument, "--cores=", 8) == 0)
+      {
+         InputCoreCount = (uint32_t)atoi(Argument + 8);
+         if (InputCoreCount == 0) // the upper bound is ConfigurationError's
          {
-            L1.MemoryTraffic += 1;
-            L1.CacheDirtyBitEviction(TagAddress, MEMORY, MEMORY);
-            L1.UpdateCacheContents(TagAddress, WriteFlag, MEMORY, MEMORY, true); // L1 Scenario #1
+            cout << "Error: --cores needs 1 to " << TraceCoreMax << " cores" << '\n';
+            exit(EXIT_FAILURE);
          }
-         else
+      }
+      else if (strcmp(Argument, "--split-l1") == 0)
+         InputSplitL1 = true;
+      else if (strcmp(Argument, "--coherence=mesi") == 0)
+         InputCoherenceProtocol = CoherenceMesi;
+      else if (strcmp(Argument, "--coherence=moesi") == 0)
+         InputCoherenceProtocol = CoherenceMoesi;
+      else if (strcmp(Argument, "--timing") == 0)
+         InputTiming = true;
+      else if (strncmp(Argument, "--timing=", 9) == 0)
+      {
+         InputTiming = true;
+         InputTimingConfiguration = ReadTimingConfiguration(Argument + 9);
+      }
+      else if (strcmp(Argument, "--format=text") == 0)
+         InputFormat = ResultsText;
+      else if (strcmp(Argument, "--format=json") == 0)
+         InputFormat = ResultsJson;
+      else if (strcmp(Argument, "--format=csv") == 0)
+         InputFormat = ResultsCsv;
+      else if (strcmp(Argument, "--no-contents") == 0)
+         InputShowContents = false;
+      else if (strncmp(Argument, "--interval=", 11) == 0)
+      {
+         InputInterval = strtoull(Argument + 11, NULL, 0);
+         if (InputInterval == 0)
          {
-            L2.ReadCount += 1;
-            if (L2.CacheMiss(TagAddress))
-            {
-               if (L2.PrefetchMiss(TagAddress))
-               {
-                  L2.ReadMissCount += 1;
-                  L2.MemoryTraffic += 1;
-                  L1.CacheDirtyBitEviction(TagAddress, L2, MEMORY);
-                  L2.UpdateCacheContents(TagAddress, false, MEMORY, MEMORY, true); // L2 Scenario #1
-                  L1.UpdateCacheContents(TagAddress, WriteFlag, L2, MEMORY, true); // L2 Scenario #1 OK
-               }
-               else
-               {
-                  // L2.PrefetchesCount += 1;
-                  L1.CacheDirtyBitEviction(TagAddress, L2, MEMORY);
-                  L2.UpdateCacheContents(TagAddress, false, MEMORY, MEMORY, true); // L2 Scenario #2
-                  L1.UpdateCacheContents(TagAddress, WriteFlag, L2, MEMORY, true); // L2 Scenario #2 OK
-               }
-            }
-            else // L2 Hit
+            cout << "Error: --interval needs a positive number of records" << '\n';
+            exit(EXIT_FAILURE);
+         }
+      }
+      else if (strncmp(Argument, "--interval-file=", 16) == 0)
+         InputIntervalFileName = Argument + 16;
+      else if (strcmp(Argument, "--stack-distance") == 0)
+         InputStackDistance = true;
+      else if (strcmp(Argument, "--mrc-check") == 0)
+         InputStackDistanceCheck = true;
+      else if (strncmp(Argument, "--threads=", 10) == 0)
+      {
+         InputThreadCount = (uint32_t)atoi(Argument + 10);
+         if (InputThreadCount == 0)
+            InputThreadCount = max(1u, thread::hardware_concurrency());
+      }
+      else if (strncmp(Argument, "--", 2) == 0)
+      {
+         cout << "Error: Unknown option " << Argument << '\n';
+         exit(EXIT_FAILURE);
+      }
+      else
+         PositionalArguments.push_back(ArgumentVariables[ArgumentCounter]);
+   }
+
+   // A sweep or a hierarchy file takes only the trace file; the configurations come from the file.
+   // Stack distance analysis takes BLOCKSIZE, SETS and the trace file.
+   if ((InputHierarchyFileName != NULL) && (InputStackDistance || (InputSweepFileName != NULL)))
+   {
+      cout << "Error: --hierarchy cannot be combined with --sweep or --stack-distance" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   // The per-core caches and the directory have no sampled, checkpointed or swept form
+   if (InputSplitL1 && (InputCoreCount == 0))
+      InputCoreCount = 1;
+   if ((InputCoreCount > 0) && (InputStackDistance || (InputSweepFileName != NULL) || (InputSampleFraction < 1) || (InputSaveCheckpointFileName != NULL) || (InputRestoreCheckpointFileName != NULL)))
+   {
+      cout << "Error: --cores and --split-l1 cannot be combined with --sweep, --stack-distance, --sample or checkpoints" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   if (InputTiming && (InputStackDistance || (InputSweepFileName != NULL) || (InputSampleFraction < 1) || (InputCoreCount > 0)))
+   {
+      cout << "Error: --timing cannot be combined with --sweep, --stack-distance, --sample or --cores" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   if (((InputInterval > 0) || (InputFormat == ResultsJson)) && InputStackDistance)
+   {
+      cout << "Error: --interval and --format=json cannot be combined with --stack-distance" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   if ((InputInterval > 0) && (InputSweepFileName != NULL))
+   {
+      cout << "Error: --interval needs a single configuration" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   size_t ExpectedArguments = InputStackDistance ? 3 : (((InputSweepFileName != NULL) || (InputHierarchyFileName != NULL)) ? 1 : 8);
+   if (PositionalArguments.size() != ExpectedArguments)
+   {
+      cout << "Error: Expected " << ExpectedArguments << " command-line arguments but was provided " << PositionalArguments.size() << '\n';
+      exit(EXIT_FAILURE);
+   }
+
+   vector<SimulatorConfiguration> Configurations;
+   if (InputStackDistance)
+      Configurations.clear(); // the analysis builds its own check hierarchies
+   else if (InputSweepFileName != NULL)
+      Configurations = ReadSweepConfigurations(InputSweepFileName);
+   else if (InputHierarchyFileName != NULL)
+      Configurations.push_back(ReadHierarchyConfiguration(InputHierarchyFileName));
+   else
+   {
+      SimulatorConfiguration Configuration;
+      Configuration.BlockSize = (uint32_t)atoi(PositionalArguments[0]);
+      Configuration.L1Size = (uint32_t)atoi(PositionalArguments[1]);
+      Configuration.L1Assoc = (uint32_t)atoi(PositionalArguments[2]);
+      Configuration.L2Size = (uint32_t)atoi(PositionalArguments[3]);
+      Configuration.L2Assoc = (uint32_t)atoi(PositionalArguments[4]);
+      Configuration.PrefetchN = (uint32_t)atoi(PositionalArguments[5]);
+      Configuration.PrefetchM = (uint32_t)atoi(PositionalArguments[6]);
+      Configuration.L1Policy = InputL1Policy;
+      Configuration.L2Policy = InputL2Policy;
+      CheckConfiguration(Configuration);
+      Configurations.push_back(Configuration);
+   }
+   for (SimulatorConfiguration &Configuration : Configurations)
+   {
+      ApplyCommandLineOptions(Configuration);
+      CheckConfiguration(Configuration);
+   }
+   if ((InputSaveCheckpointFileName != NULL) && (Configurations.size() != 1))
+   {
+      cout << "Error: --save-checkpoint needs a single configuration" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   InputTraceFileName = PositionalArguments.back();
+   InputTraceFileNameString = InputTraceFileName;
+
+   vector<unique_ptr<CacheHierarchy>> Hierarchies;
+   for (const SimulatorConfiguration &Configuration : Configurations)
+      Hierarchies.emplace_back(new CacheHierarchy(Configuration));
+
+   // --mmap parses the trace in place; compressed or unmappable traces fall back to buffered reads
+   TraceReader Trace;
+   bool TraceMapped = InputMapTrace && Trace.Open(TraceMapping::Map(InputTraceFileName));
+   if (!TraceMapped && !Trace.Open(InputTraceFileName))
+      exit(EXIT_FAILURE);
+
+   if (InputRestoreCheckpointFileName != NULL)
+   {
+      uint64_t TraceOffset = RestoreCheckpoint(InputRestoreCheckpointFileName, Hierarchies);
+      if (Trace.SkipRecords(TraceOffset) != TraceOffset)
+      {
+         cout << "Error: Trace ends before checkpoint offset " << TraceOffset << '\n';
+         exit(EXIT_FAILURE);
+      }
+   }
+   if (InputRecordLimit > 0)
+      Trace.RecordLimit = Trace.RecordsRead + InputRecordLimit;
+
+   if (InputStackDistance)
+   {
+      StackDistanceAnalysis((uint32_t)atoi(PositionalArguments[0]), (uint32_t)atoi(PositionalArguments[1]), Trace);
+      return (0);
+   }
+
+   // The trace is decoded once; a sweep runs every hierarchy over each small batch while the
+   // batch is still in the host cache, or spreads the hierarchies over --threads workers. A
+   // single configuration spreads its set classes over the workers when they are independent.
+   size_t BatchSize = (Hierarchies.size() > 1) ? SweepBatchSize : TraceBatchSize;
+   if ((InputThreadCount > 1) && (Hierarchies.size() > 1))
+   {
+      SweepScheduler::Run(Trace, Hierarchies.size(), InputThreadCount, BatchSize, [&Hierarchies](size_t Simulation, const TraceRecord *Records, size_t RecordCount)
+                          { Hierarchies[Simulation]->Simulate(Records, RecordCount); });
+   }
+   else if ((InputThreadCount > 1) && (InputInterval == 0) && SetPartitionedRun::Supported(*Hierarchies[0]))
+      SetPartitionedRun::Run(Trace, *Hierarchies[0], InputThreadCount, SweepBatchSize);
+   else
+   {
+      // --interval splits the batches at the interval boundaries
+      unique_ptr<ofstream> IntervalFile;
+      unique_ptr<IntervalReporter> Intervals;
+      if (InputInterval > 0)
+      {
+         if (InputIntervalFileName != NULL)
+         {
+            IntervalFile.reset(new ofstream(InputIntervalFileName));
+            if (!IntervalFile->is_open())
             {
-               if (L2.PrefetchMiss(TagAddress))
-               {
-                  L1.CacheDirtyBitEviction(TagAddress, L2, MEMORY);
-                  L2.UpdateCacheContents(TagAddress, false, MEMORY, MEMORY, false); // L2 Scenario #3 OK
-                  L1.UpdateCacheContents(TagAddress, WriteFlag, L2, MEMORY, true);  // L2 Scenario #3 OK
-               }
-               else
-               {
-                  L1.CacheDirtyBitEviction(TagAddress, L2, MEMORY);
-                  L2.UpdateCacheContents(TagAddress, false, MEMORY, MEMORY, true); // L2 Scenario #4
-                  L1.UpdateCacheContents(TagAddress, WriteFlag, L2, MEMORY, true); // L2 Scenario #4 OK
-               }
+               cout << "Error: Cannot write interval file " << InputIntervalFileName << '\n';
+               exit(EXIT_FAILURE);
             }
          }
+         Intervals.reset(new IntervalReporter(*Hierarchies[0], InputInterval, Trace.RecordsRead, IntervalFile ? *IntervalFile : cout));
       }
-      else
+      vector<TraceRecord> TraceRecords(BatchSize);
+      size_t RecordCount;
+      while ((RecordCount = Trace.ReadRecords(TraceRecords.data(), BatchSize)) > 0)
       {
-         // L1.PrefetchesCount += 1;
-         L1.CacheDirtyBitEviction(TagAddress, L2, MEMORY);
-         L1.UpdateCacheContents(TagAddress, WriteFlag, L2, MEMORY, true); // L1 Scenario #2
+         if (Intervals != NULL)
+         {
+            for (size_t RecordCounter = 0; RecordCounter < RecordCount;)
+            {
+               size_t IntervalRecords = (size_t)min<uint64_t>(RecordCount - RecordCounter, Intervals->RemainingRecords());
+               SimulateTraceRecords(*Hierarchies[0], TraceRecords.data() + RecordCounter, IntervalRecords);
+               Intervals->Advance(IntervalRecords);
+               RecordCounter += IntervalRecords;
+            }
+            continue;
+         }
+         for (unique_ptr<CacheHierarchy> &Hierarchy : Hierarchies)
+            SimulateTraceRecords(*Hierarchy, TraceRecords.data(), RecordCount);
       }
+      if (Intervals != NULL)
+         Intervals->Finish();
+   }
+
+   if (InputSaveCheckpointFileName != NULL)
+      SaveCheckpoint(InputSaveCheckpointFileName, *Hierarchies[0], Trace.RecordsRead);
+
+   for (unique_ptr<CacheHierarchy> &Hierarchy : Hierarchies)
+      Hierarchy->Finish();
+
+   if (InputFormat == ResultsJson)
+   {
+      for (unique_ptr<CacheHierarchy> &Hierarchy : Hierarchies)
+         CacheSimulatorResults(*Hierarchy).WriteJson(cout);
    }
-   else // L1 HIT
+   else if ((InputFormat == ResultsCsv) && (InputSweepFileName == NULL))
    {
-      if (L1.PrefetchMiss(TagAddress))
-         L1.UpdateCacheContents(TagAddress, WriteFlag, L2, MEMORY, false); // L1 Scenario #3 OK
+      Results Report = CacheSimulatorResults(*Hierarchies[0]);
+      Report.WriteCsvHeader(cout);
+      Report.WriteCsvRow(cout);
+   }
+   else if (InputSweepFileName == NULL)
+   {
+      if (Hierarchies[0]->Cores != NULL)
+         CacheSimulatorCoresData(*Hierarchies[0]);
+      else if (Hierarchies[0]->Levels.size() > 2)
+         CacheSimulatorLevelsData(*Hierarchies[0]);
       else
-         L1.UpdateCacheContents(TagAddress, WriteFlag, L2, MEMORY, true); // L1 Scenario #4
+         CacheSimulatorFinalData(Hierarchies[0]->L1, Hierarchies[0]->L2);
+      if (Hierarchies[0]->Sampler.Enabled)
+         CacheSimulatorSamplingData(Hierarchies[0]->Sampler);
+      CacheSimulatorPrefetcherData(*Hierarchies[0]);
+      if (Hierarchies[0]->Timing != NULL)
+         CacheSimulatorTimingData(*Hierarchies[0]);
    }
-   return true;
+   else
+   {
+      CacheSimulatorSweepHeader();
+      for (unique_ptr<CacheHierarchy> &Hierarchy : Hierarchies)
+         CacheSimulatorSweepRow(*Hierarchy);
+   }
+   return (0);
 }
 
-void CacheSimulatorFinalData(CacheModule L1, CacheModule L2)
+void CacheSimulatorSamplingData(const SetSampler &Sampler)
+{
+   cout << "===== Set sampling =====" << endl;
+   cout << "sampled set classes:           " << Sampler.SampledClassCount << " of " << (Sampler.ClassMask + 1) << endl;
+   cout << "L1 miss rate 95% CI:           +/- " << fixed << setprecision(4) << Sampler.MissRateHalfWidth(1) << endl;
+   cout << "L2 miss rate 95% CI:           +/- " << fixed << setprecision(4) << Sampler.MissRateHalfWidth(2) << endl;
+}
+
+void CacheSimulatorFinalData(CacheModule &L1, CacheModule &L2)
 {
    cout << "===== Simulator configuration =====" << endl;
    cout << "BLOCKSIZE:  " << to_string(L1.BLOCKSIZE) << endl;
@@ -169,45 +941,410 @@ void CacheSimulatorFinalData(CacheModule L1, CacheModule L2)
    cout << "L2_ASSOC:   " << to_string(L2.ASSOC) << endl;
    cout << "PREF_N:     " << to_string(L1.PREF_N + L2.PREF_N) << endl;
    cout << "PREF_M:     " << to_string(L1.PREF_M + L2.PREF_M) << endl;
+   if ((L1.ReplacementPolicy != LruPolicy) || ((L2.SIZE != 0) && (L2.ReplacementPolicy != LruPolicy)))
+   {
+      cout << "L1_POLICY:  " << ReplacementPolicyNames[L1.ReplacementPolicy] << endl;
+      cout << "L2_POLICY:  " << ReplacementPolicyNames[L2.ReplacementPolicy] << endl;
+   }
+   if (L1.PrefetchEngine || L2.PrefetchEngine)
+   {
+      cout << "L1_PREFETCHER: " << (L1.PrefetchEngine ? L1.PrefetchEngine->Specification : "none") << endl;
+      cout << "L2_PREFETCHER: " << (L2.PrefetchEngine ? L2.PrefetchEngine->Specification : "none") << endl;
+   }
 
    cout << "trace_file: " + InputTraceFileNameString << endl;
 
-   L1.CacheOutputDisplay("L1");
-   L1.StreamBufferDisplay();
-   L2.CacheOutputDisplay("L2");
-   L2.StreamBufferDisplay();
+   if (InputShowContents)
+   {
+      L1.CacheOutputDisplay("L1");
+      L1.StreamBufferDisplay();
+      L2.CacheOutputDisplay("L2");
+      L2.StreamBufferDisplay();
 
-   // if ((L2.SIZE != 0) && L2.PREF_N == 0)
-   if (L2.SIZE != 0)
-      cout << endl;
+      // if ((L2.SIZE != 0) && L2.PREF_N == 0)
+      if (L2.SIZE != 0)
+         cout << endl;
+   }
 
    cout << "===== Measurements =====" << endl;
-   cout << "a. L1 reads:                   " << to_string(L1.ReadCount) << endl;
-   cout << "b. L1 read misses:             " << to_string(L1.ReadMissCount) << endl;
-   cout << "c. L1 writes:                  " << to_string(L1.WriteCount) << endl;
-   cout << "d. L1 write misses:            " << to_string(L1.WriteMissCount) << endl;
-   cout << "e. L1 miss rate:               " << fixed << setprecision(4) << (double(L1.ReadMissCount + L1.WriteMissCount) / double(L1.ReadCount + L1.WriteCount)) << endl;
-   // printf("e. L1 miss rate:               %.4f\n", (double(L1.ReadMissCount + L1.WriteMissCount) / double(L1.ReadCount + L1.WriteCount)));
-   cout << "f. L1 writebacks:              " << to_string(L1.WriteBackCount) << endl;
-   cout << "g. L1 prefetches:              " << to_string(L1.PrefetchesCount) << endl;
-
-   cout << "h. L2 reads (demand):          " << to_string(L2.ReadCount) << endl;
-   cout << "i. L2 read misses (demand):    " << to_string(L2.ReadMissCount) << endl;
-   cout << "j. L2 reads (prefetch):        " << to_string(L2.ReadPrefetchCount) << endl;
-   cout << "k. L2 read misses (prefetch):  " << to_string(L2.ReadMissPrefetchCount) << endl;
-   cout << "l. L2 writes:                  " << to_string(L2.WriteCount) << endl;
-   cout << "m. L2 write misses:            " << to_string(L2.WriteMissCount) << endl;
-   if ((L2.ReadCount) == 0)
+   cout << "a. L1 reads:                   " << to_string(L1.Statistics.ReadCount) << endl;
+   cout << "b. L1 read misses:             " << to_string(L1.Statistics.ReadMissCount) << endl;
+   cout << "c. L1 writes:                  " << to_string(L1.Statistics.WriteCount) << endl;
+   cout << "d. L1 write misses:            " << to_string(L1.Statistics.WriteMissCount) << endl;
+   cout << "e. L1 miss rate:               " << fixed << setprecision(4) << (double(L1.Statistics.ReadMissCount + L1.Statistics.WriteMissCount) / double(L1.Statistics.ReadCount + L1.Statistics.WriteCount)) << endl;
+   // printf("e. L1 miss rate:               %.4f\n", (double(L1.Statistics.ReadMissCount + L1.Statistics.WriteMissCount) / double(L1.Statistics.ReadCount + L1.Statistics.WriteCount)));
+   cout << "f. L1 writebacks:              " << to_string(L1.Statistics.WriteBackCount) << endl;
+   cout << "g. L1 prefetches:              " << to_string(L1.Statistics.PrefetchesCount) << endl;
+
+   cout << "h. L2 reads (demand):          " << to_string(L2.Statistics.ReadCount) << endl;
+   cout << "i. L2 read misses (demand):    " << to_string(L2.Statistics.ReadMissCount) << endl;
+   cout << "j. L2 reads (prefetch):        " << to_string(L2.Statistics.ReadPrefetchCount) << endl;
+   cout << "k. L2 read misses (prefetch):  " << to_string(L2.Statistics.ReadMissPrefetchCount) << endl;
+   cout << "l. L2 writes:                  " << to_string(L2.Statistics.WriteCount) << endl;
+   cout << "m. L2 write misses:            " << to_string(L2.Statistics.WriteMissCount) << endl;
+   if ((L2.Statistics.ReadCount) == 0)
    {
       cout << "n. L2 miss rate:               " << fixed << setprecision(4) << (double(0)) << endl;
       // printf("e. L2 miss rate:               %.4f\n", (double(0)));
    }
    else
    {
-      cout << "n. L2 miss rate:               " << fixed << setprecision(4) << ((double(L2.ReadMissCount) / double(L2.ReadCount))) << endl;
-      // printf("e. L2 miss rate:               %.4f\n", ((double(L2.ReadMissCount) / double(L2.ReadCount))));
+      cout << "n. L2 miss rate:               " << fixed << setprecision(4) << ((double(L2.Statistics.ReadMissCount) / double(L2.Statistics.ReadCount))) << endl;
+      // printf("e. L2 miss rate:               %.4f\n", ((double(L2.Statistics.ReadMissCount) / double(L2.Statistics.ReadCount))));
+   }
+   cout << "o. L2 writebacks:              " << to_string(L2.Statistics.WriteBackCount) << endl;
+   cout << "p. L2 prefetches:              " << to_string(L2.Statistics.PrefetchesCount) << endl;
+   cout << "q. memory traffic:             " << to_string(L1.Statistics.MemoryTraffic + L2.Statistics.MemoryTraffic) << endl;
+}
+
+void CacheSimulatorLevelConfiguration(const LevelConfiguration &Level)
+{
+   cout << Level.Name << ":" << string((Level.Name.size() < 11) ? 11 - Level.Name.size() : 1, ' ') << "SIZE " << Level.Size << ", ASSOC " << Level.Assoc
+        << ", PREF_N " << Level.PrefetchN << ", PREF_M " << Level.PrefetchM << ", POLICY " << ReplacementPolicyNames[Level.Policy]
+        << ((Level.Prefetcher != "none") ? ", PREFETCHER " + Level.Prefetcher : "") << endl;
+}
+
+// The top level's miss rate covers all its accesses, the lower levels' only demand reads
+void CacheSimulatorLevelMeasurements(const string &Name, const CacheModule &Cache, bool TopFlag)
+{
+   uint64_t Accesses = Cache.Statistics.DemandAccesses(TopFlag);
+   uint64_t Misses = Cache.Statistics.DemandMisses(TopFlag);
+   vector<pair<string, string>> Rows = {
+       {"reads (demand)", to_string(Cache.Statistics.ReadCount)},
+       {"read misses (demand)", to_string(Cache.Statistics.ReadMissCount)},
+       {"reads (prefetch)", to_string(Cache.Statistics.ReadPrefetchCount)},
+       {"read misses (prefetch)", to_string(Cache.Statistics.ReadMissPrefetchCount)},
+       {"writes", to_string(Cache.Statistics.WriteCount)},
+       {"write misses", to_string(Cache.Statistics.WriteMissCount)},
+       {"miss rate", ""},
+       {"writebacks", to_string(Cache.Statistics.WriteBackCount)},
+       {"prefetches", to_string(Cache.Statistics.PrefetchesCount)}};
+   for (const pair<string, string> &Row : Rows)
+   {
+      cout << left << setw(31) << (Name + " " + Row.first + ":") << right;
+      if (Row.first == "miss rate")
+         cout << fixed << setprecision(4) << ((Accesses == 0) ? double(0) : (double(Misses) / double(Accesses))) << endl;
+      else
+         cout << Row.second << endl;
+   }
+}
+
+// The report for hierarchies deeper than L1/L2: configuration, contents and measurements per level
+void CacheSimulatorLevelsData(const CacheHierarchy &Hierarchy)
+{
+   vector<LevelConfiguration> Levels = ConfigurationLevels(Hierarchy.Configuration);
+   cout << "===== Simulator configuration =====" << endl;
+   cout << "BLOCKSIZE:  " << to_string(Hierarchy.Configuration.BlockSize) << endl;
+   for (const LevelConfiguration &Level : Levels)
+      CacheSimulatorLevelConfiguration(Level);
+   cout << "trace_file: " + InputTraceFileNameString << endl;
+
+   for (uint32_t Level = 0; InputShowContents && (Level < Levels.size()); Level++)
+   {
+      Hierarchy.Levels[Level]->CacheOutputDisplay(Levels[Level].Name);
+      Hierarchy.Levels[Level]->StreamBufferDisplay();
+   }
+   if (InputShowContents)
+      cout << endl;
+
+   cout << "===== Measurements =====" << endl;
+   uint64_t MemoryTraffic = 0;
+   for (uint32_t Level = 0; Level < Levels.size(); Level++)
+   {
+      CacheSimulatorLevelMeasurements(Levels[Level].Name, *Hierarchy.Levels[Level], Level == 0);
+      MemoryTraffic += Hierarchy.Levels[Level]->Statistics.MemoryTraffic;
+   }
+   cout << left << setw(31) << "memory traffic:" << right << to_string(MemoryTraffic) << endl;
+}
+
+// The --cores report: the configuration, the shared levels' contents, one CSV row per private
+// cache, and the private caches' totals followed by the shared levels
+void CacheSimulatorCoresData(const CacheHierarchy &Hierarchy)
+{
+   CoherentCores &Cores = *Hierarchy.Cores;
+   vector<LevelConfiguration> Levels = ConfigurationLevels(Hierarchy.Configuration);
+   cout << "===== Simulator configuration =====" << endl;
+   cout << "BLOCKSIZE:  " << to_string(Hierarchy.Configuration.BlockSize) << endl;
+   for (uint32_t Level = 0; Level < Hierarchy.LevelCount; Level++)
+      CacheSimulatorLevelConfiguration(Levels[Level]);
+   cout << "CORES:      " << Cores.CoreCount << ((Cores.SplitFlag) ? ", split " : ", unified ") << Levels[0].Name << " per core" << endl;
+   cout << "COHERENCE:  " << ((Cores.Protocol == CoherenceMoesi) ? "moesi" : "mesi") << endl;
+   cout << "trace_file: " + InputTraceFileNameString << endl;
+
+   for (uint32_t Level = 1; InputShowContents && (Level < Hierarchy.LevelCount); Level++)
+   {
+      Hierarchy.Levels[Level]->CacheOutputDisplay(Levels[Level].Name);
+      Hierarchy.Levels[Level]->StreamBufferDisplay();
+   }
+   if (InputShowContents)
+      cout << endl;
+
+   cout << "===== Private cache measurements =====" << endl;
+   cout << "core,cache,reads,read_misses,writes,write_misses,miss_rate,writebacks,invalidations,coherence_misses,upgrades,interventions" << endl;
+   for (uint32_t Core = 0; Core < Cores.CoreCount; Core++)
+   {
+      for (PrivateCache *Private : {&Cores.DataCaches[Core], Cores.SplitFlag ? &Cores.InstructionCaches[Core] : (PrivateCache *)NULL})
+      {
+         if (Private == NULL)
+            continue;
+         const CacheModule &Cache = *Private->Cache;
+         const CoherenceStatistics &Statistics = Private->Statistics;
+         uint64_t Accesses = Cache.Statistics.DemandAccesses(true);
+         cout << Core << ',' << (!Cores.SplitFlag ? "L1" : ((Private == &Cores.DataCaches[Core]) ? "L1D" : "L1I")) << ','
+              << Cache.Statistics.ReadCount << ',' << Cache.Statistics.ReadMissCount << ',' << Cache.Statistics.WriteCount << ',' << Cache.Statistics.WriteMissCount << ','
+              << fixed << setprecision(4) << ((Accesses == 0) ? double(0) : (double(Cache.Statistics.ReadMissCount + Cache.Statistics.WriteMissCount) / double(Accesses))) << ','
+              << Cache.Statistics.WriteBackCount << ',' << Statistics.Invalidations << ',' << Statistics.CoherenceMisses << ',' << Statistics.Upgrades << ',' << Statistics.Interventions << '\n';
+      }
+   }
+   CacheModule Total(Hierarchy.Configuration.BlockSize, 0, 0, 0, 0);
+   CoherenceStatistics TotalStatistics;
+   SumPrivateCaches(Cores, Total, TotalStatistics);
+
+   cout << "===== Measurements =====" << endl;
+   CacheSimulatorLevelMeasurements(Levels[0].Name, Total, true);
+   cout << left << setw(31) << "invalidations:" << right << TotalStatistics.Invalidations << endl;
+   cout << left << setw(31) << "coherence misses:" << right << TotalStatistics.CoherenceMisses << endl;
+   cout << left << setw(31) << "upgrades:" << right << TotalStatistics.Upgrades << endl;
+   cout << left << setw(31) << "cache-to-cache transfers:" << right << TotalStatistics.Interventions << endl;
+   uint64_t MemoryTraffic = Total.Statistics.MemoryTraffic;
+   for (uint32_t Level = 1; Level < Hierarchy.LevelCount; Level++)
+   {
+      CacheSimulatorLevelMeasurements(Levels[Level].Name, *Hierarchy.Levels[Level], false);
+      MemoryTraffic += Hierarchy.Levels[Level]->Statistics.MemoryTraffic;
+   }
+   cout << left << setw(31) << "memory traffic:" << right << to_string(MemoryTraffic) << endl;
+}
+
+// The --timing report: the latencies used, the access time and where accesses were served, the
+// DRAM, MSHR and write-back buffer behaviour, and memory traffic per interval of cycles
+void CacheSimulatorTimingData(const CacheHierarchy &Hierarchy)
+{
+   const TimingModel &Timing = *Hierarchy.Timing;
+   vector<LevelConfiguration> Levels = ConfigurationLevels(Hierarchy.Configuration);
+   double Cycles = max(double(Timing.Cycle), double(1));
+   double NanosecondsPerCycle = 1 / Timing.Configuration.ClockGhz;
+   cout << "===== Timing =====" << endl;
+   for (uint32_t Level = 0; Level < Timing.Levels.size(); Level++)
+      cout << left << setw(31) << (Levels[Level].Name + " hit latency:") << right << Timing.HitLatencies[Level] << endl;
+   cout << left << setw(31) << "cycles:" << right << Timing.Cycle << endl;
+   cout << left << setw(31) << "average access time:" << right << fixed << setprecision(4)
+        << (double(Timing.Cycle) / max(double(Timing.AccessCount), double(1))) << " cycles ("
+        << (double(Timing.Cycle) * NanosecondsPerCycle / max(double(Timing.AccessCount), double(1))) << " ns)" << endl;
+   for (uint32_t Level = 0; Level <= Timing.Levels.size(); Level++)
+      cout << left << setw(31) << ("served by " + ((Level < Timing.Levels.size()) ? Levels[Level].Name : string("memory")) + ":") << right << Timing.ServedCounts[Level] << endl;
+   cout << left << setw(31) << "memory reads:" << right << Timing.MemoryReadCount << endl;
+   cout << left << setw(31) << "memory writes:" << right << Timing.MemoryWriteCount << endl;
+   cout << left << setw(31) << "average memory read latency:" << right << setprecision(4)
+        << (double(Timing.DemandReadCycles) / max(double(Timing.DemandReadCount), double(1))) << " cycles" << endl;
+   uint64_t RowAccesses = Timing.RowHitCount + Timing.RowEmptyCount + Timing.RowConflictCount;
+   cout << left << setw(31) << "DRAM row hits/empty/conflicts:" << right << Timing.RowHitCount << " / " << Timing.RowEmptyCount << " / " << Timing.RowConflictCount << endl;
+   cout << left << setw(31) << "DRAM row buffer hit rate:" << right << setprecision(4)
+        << (double(Timing.RowHitCount) / max(double(RowAccesses), double(1))) << endl;
+   cout << left << setw(31) << "MSHR wait cycles:" << right << Timing.MshrWaitCycles << endl;
+   cout << left << setw(31) << "MSHR occupancy:" << right << setprecision(4) << (double(Timing.MshrBusyCycles) / Cycles) << endl;
+   cout << left << setw(31) << "prefetch wait cycles:" << right << Timing.PrefetchWaitCycles << endl;
+   cout << left << setw(31) << "write-back stall cycles:" << right << Timing.WriteBackStallCycles << endl;
+   cout << left << setw(31) << "write-back buffer occupancy:" << right << setprecision(4) << (double(Timing.WriteBackBusyCycles) / Cycles) << endl;
+   cout << left << setw(31) << "effective bandwidth:" << right << setprecision(4) << (double(Timing.MemoryBytes()) / Cycles) << " B/cycle ("
+        << (double(Timing.MemoryBytes()) / Cycles * Timing.Configuration.ClockGhz) << " GB/s, peak "
+        << (double(Timing.Configuration.DramBusBytes) * Timing.Configuration.ClockGhz) << ")" << endl;
+
+   cout << "===== Memory traffic over time =====" << endl;
+   cout << "cycle_start,cycle_end,reads,writes,bandwidth_gbps" << endl;
+   for (uint32_t Interval = 0; Interval < Timing.Intervals.size(); Interval++)
+   {
+      const TimingInterval &Traffic = Timing.Intervals[Interval];
+      cout << Interval * Timing.IntervalWidth << ',' << (Interval + 1) * Timing.IntervalWidth << ',' << Traffic.Reads << ',' << Traffic.Writes << ','
+           << setprecision(4) << (double((Traffic.Reads + Traffic.Writes) * Timing.BlockSize) / double(Timing.IntervalWidth) * Timing.Configuration.ClockGhz) << '\n';
+   }
+}
+
+// Per-level prefetcher engine report: accuracy is useful/issued, coverage the share of would-be
+// demand misses the engine's prefetches turned into hits, and lead the mean number of demand
+// accesses to the level between a prefetch and its first use
+void CacheSimulatorPrefetcherData(const CacheHierarchy &Hierarchy)
+{
+   vector<LevelConfiguration> Levels = ConfigurationLevels(Hierarchy.Configuration);
+   bool HeaderFlag = false;
+   for (uint32_t Level = 0; Level < Hierarchy.LevelCount; Level++)
+   {
+      const CacheModule &Cache = *Hierarchy.Levels[Level];
+      if (!Cache.PrefetchEngine)
+         continue;
+      if (!HeaderFlag)
+         cout << "===== Prefetchers =====" << endl;
+      HeaderFlag = true;
+      const Prefetcher &Engine = *Cache.PrefetchEngine;
+      uint64_t DemandMisses = Cache.Statistics.DemandMisses(Level == 0);
+      uint64_t WastedBlocks = Engine.UselessCount + Engine.UnusedCount();
+      const string &Name = Levels[Level].Name;
+      cout << left << setw(31) << (Name + " prefetcher:") << right << Engine.Specification << endl;
+      cout << left << setw(31) << (Name + " prefetches issued:") << right << Engine.IssuedCount << endl;
+      cout << left << setw(31) << (Name + " prefetches useful:") << right << Engine.UsefulCount << endl;
+      cout << left << setw(31) << (Name + " prefetches useless:") << right << Engine.UselessCount << endl;
+      cout << left << setw(31) << (Name + " prefetches unused at end:") << right << Engine.UnusedCount() << endl;
+      cout << left << setw(31) << (Name + " prefetches redundant:") << right << Engine.RedundantCount << endl;
+      cout << left << setw(31) << (Name + " prefetch accuracy:") << right << fixed << setprecision(4)
+           << (double(Engine.UsefulCount) / max(double(Engine.IssuedCount), double(1))) << endl;
+      cout << left << setw(31) << (Name + " prefetch coverage:") << right << setprecision(4)
+           << (double(Engine.UsefulCount) / max(double(Engine.UsefulCount + DemandMisses), double(1))) << endl;
+      cout << left << setw(31) << (Name + " prefetch lead:") << right << setprecision(4)
+           << (double(Engine.LeadSum) / max(double(Engine.UsefulCount), double(1))) << " accesses" << endl;
+      cout << left << setw(31) << (Name + " useless prefetch traffic:") << right << WastedBlocks << " blocks ("
+           << WastedBlocks * Cache.BLOCKSIZE << " bytes)" << endl;
+   }
+}
+
+// --format=json|csv: the report as Results, with the same measurements as the text report but
+// never the cache contents
+Results CacheSimulatorResults(const CacheHierarchy &Hierarchy)
+{
+   Results Report;
+   vector<LevelConfiguration> Levels = ConfigurationLevels(Hierarchy.Configuration);
+   Report.Group("configuration").Integer("blocksize", Hierarchy.Configuration.BlockSize).Text("trace_file", InputTraceFileNameString);
+   if (Hierarchy.Cores != NULL)
+   {
+      Report.Group("configuration")
+          .Integer("cores", Hierarchy.Cores->CoreCount)
+          .Text("top_level", Hierarchy.Cores->SplitFlag ? "split" : "unified")
+          .Text("coherence", (Hierarchy.Cores->Protocol == CoherenceMoesi) ? "moesi" : "mesi");
+   }
+
+   // With --cores the top level's counters are the private caches' totals
+   CacheModule Total(Hierarchy.Configuration.BlockSize, 0, 0, 0, 0);
+   CoherenceStatistics TotalStatistics;
+   if (Hierarchy.Cores != NULL)
+      SumPrivateCaches(*Hierarchy.Cores, Total, TotalStatistics);
+   uint64_t MemoryTraffic = 0;
+   for (uint32_t Level = 0; Level < Levels.size(); Level++)
+   {
+      const CacheModule &Cache = ((Level == 0) && (Hierarchy.Cores != NULL)) ? Total : *Hierarchy.Levels[Level];
+      uint64_t Accesses = Cache.Statistics.DemandAccesses(Level == 0);
+      uint64_t Misses = Cache.Statistics.DemandMisses(Level == 0);
+      Report.Append("levels", Levels[Level].Name)
+          .Integer("size", Levels[Level].Size)
+          .Integer("assoc", Levels[Level].Assoc)
+          .Integer("pref_n", Levels[Level].PrefetchN)
+          .Integer("pref_m", Levels[Level].PrefetchM)
+          .Text("policy", ReplacementPolicyNames[Levels[Level].Policy])
+          .Text("prefetcher", Levels[Level].Prefetcher)
+          .Integer("reads", Cache.Statistics.ReadCount)
+          .Integer("read_misses", Cache.Statistics.ReadMissCount)
+          .Integer("prefetch_reads", Cache.Statistics.ReadPrefetchCount)
+          .Integer("prefetch_read_misses", Cache.Statistics.ReadMissPrefetchCount)
+          .Integer("writes", Cache.Statistics.WriteCount)
+          .Integer("write_misses", Cache.Statistics.WriteMissCount)
+          .Fraction("miss_rate", (Accesses == 0) ? double(0) : (double(Misses) / double(Accesses)))
+          .Integer("writebacks", Cache.Statistics.WriteBackCount)
+          .Integer("prefetches", Cache.Statistics.PrefetchesCount)
+          .Integer("prefetch_hits", Cache.Statistics.PrefetchHitCount)
+          .Integer("useless_prefetches", Cache.Statistics.UselessPrefetchCount)
+          .Integer("memory_writebacks", Cache.Statistics.MemoryWriteBackCount);
+      MemoryTraffic += Cache.Statistics.MemoryTraffic;
+   }
+   Report.Group("measurements").Integer("memory_traffic", MemoryTraffic);
+
+   if (Hierarchy.Cores != NULL)
+   {
+      const CoherentCores &Cores = *Hierarchy.Cores;
+      Report.Group("measurements")
+          .Integer("invalidations", TotalStatistics.Invalidations)
+          .Integer("coherence_misses", TotalStatistics.CoherenceMisses)
+          .Integer("upgrades", TotalStatistics.Upgrades)
+          .Integer("cache_to_cache_transfers", TotalStatistics.Interventions);
+      for (uint32_t Core = 0; Core < Cores.CoreCount; Core++)
+      {
+         for (const PrivateCache *Private : {&Cores.DataCaches[Core], Cores.SplitFlag ? &Cores.InstructionCaches[Core] : (const PrivateCache *)NULL})
+         {
+            if (Private == NULL)
+               continue;
+            const CacheModule &Cache = *Private->Cache;
+            string CacheName = !Cores.SplitFlag ? "L1" : ((Private == &Cores.DataCaches[Core]) ? "L1D" : "L1I");
+            Report.Append("cores", "core" + to_string(Core) + "_" + CacheName)
+                .Integer("core", Core)
+                .Text("cache", CacheName)
+                .Integer("reads", Cache.Statistics.ReadCount)
+                .Integer("read_misses", Cache.Statistics.ReadMissCount)
+                .Integer("writes", Cache.Statistics.WriteCount)
+                .Integer("write_misses", Cache.Statistics.WriteMissCount)
+                .Fraction("miss_rate", double(Cache.Statistics.ReadMissCount + Cache.Statistics.WriteMissCount) / double(Cache.Statistics.ReadCount + Cache.Statistics.WriteCount))
+                .Integer("writebacks", Cache.Statistics.WriteBackCount)
+                .Integer("invalidations", Private->Statistics.Invalidations)
+                .Integer("coherence_misses", Private->Statistics.CoherenceMisses)
+                .Integer("upgrades", Private->Statistics.Upgrades)
+                .Integer("interventions", Private->Statistics.Interventions);
+         }
+      }
+   }
+
+   if (Hierarchy.Sampler.Enabled)
+   {
+      Report.Group("sampling")
+          .Integer("sampled_set_classes", Hierarchy.Sampler.SampledClassCount)
+          .Integer("set_classes", Hierarchy.Sampler.ClassMask + 1)
+          .Fraction("l1_miss_rate_ci", Hierarchy.Sampler.MissRateHalfWidth(1))
+          .Fraction("l2_miss_rate_ci", Hierarchy.Sampler.MissRateHalfWidth(2));
+   }
+
+   for (uint32_t Level = 0; Level < Hierarchy.LevelCount; Level++)
+   {
+      const CacheModule &Cache = *Hierarchy.Levels[Level];
+      if (!Cache.PrefetchEngine)
+         continue;
+      const Prefetcher &Engine = *Cache.PrefetchEngine;
+      uint64_t DemandMisses = Cache.Statistics.DemandMisses(Level == 0);
+      Report.Append("prefetchers", Levels[Level].Name)
+          .Integer("prefetches_issued", Engine.IssuedCount)
+          .Integer("prefetches_useful", Engine.UsefulCount)
+          .Integer("prefetches_useless", Engine.UselessCount)
+          .Integer("prefetches_unused", Engine.UnusedCount())
+          .Integer("prefetches_redundant", Engine.RedundantCount)
+          .Fraction("prefetch_accuracy", double(Engine.UsefulCount) / double(Engine.IssuedCount))
+          .Fraction("prefetch_coverage", double(Engine.UsefulCount) / double(Engine.UsefulCount + DemandMisses))
+          .Fraction("prefetch_lead", double(Engine.LeadSum) / double(Engine.UsefulCount))
+          .Integer("prefetch_wasted_blocks", Engine.UselessCount + Engine.UnusedCount());
+   }
+
+   if (Hierarchy.Timing != NULL)
+   {
+      const TimingModel &Timing = *Hierarchy.Timing;
+      double Cycles = max(double(Timing.Cycle), double(1));
+      uint64_t RowAccesses = Timing.RowHitCount + Timing.RowEmptyCount + Timing.RowConflictCount;
+      Report.Group("timing")
+          .Integer("cycles", Timing.Cycle)
+          .Fraction("average_access_time", double(Timing.Cycle) / double(Timing.AccessCount))
+          .Fraction("average_access_time_ns", double(Timing.Cycle) / Timing.Configuration.ClockGhz / double(Timing.AccessCount))
+          .Integer("memory_reads", Timing.MemoryReadCount)
+          .Integer("memory_writes", Timing.MemoryWriteCount)
+          .Fraction("memory_read_latency", double(Timing.DemandReadCycles) / double(Timing.DemandReadCount))
+          .Integer("dram_row_hits", Timing.RowHitCount)
+          .Integer("dram_row_empty", Timing.RowEmptyCount)
+          .Integer("dram_row_conflicts", Timing.RowConflictCount)
+          .Fraction("dram_row_hit_rate", double(Timing.RowHitCount) / double(RowAccesses))
+          .Integer("mshr_wait_cycles", Timing.MshrWaitCycles)
+          .Fraction("mshr_occupancy", double(Timing.MshrBusyCycles) / Cycles)
+          .Integer("prefetch_wait_cycles", Timing.PrefetchWaitCycles)
+          .Integer("writeback_stall_cycles", Timing.WriteBackStallCycles)
+          .Fraction("writeback_buffer_occupancy", double(Timing.WriteBackBusyCycles) / Cycles)
+          .Fraction("bandwidth_gbps", double(Timing.MemoryBytes()) / Cycles * Timing.Configuration.ClockGhz)
+          .Fraction("peak_bandwidth_gbps", double(Timing.Configuration.DramBusBytes) * Timing.Configuration.ClockGhz);
+      for (uint32_t Level = 0; Level <= Timing.Levels.size(); Level++)
+      {
+         ResultRecord &Served = Report.Append("timing_levels", (Level < Timing.Levels.size()) ? Levels[Level].Name : string("memory"));
+         if (Level < Timing.Levels.size())
+            Served.Integer("hit_latency", Timing.HitLatencies[Level]);
+         Served.Integer("served", Timing.ServedCounts[Level]);
+      }
+      for (uint32_t Interval = 0; Interval < Timing.Intervals.size(); Interval++)
+      {
+         const TimingInterval &Traffic = Timing.Intervals[Interval];
+         Report.Append("memory_traffic_intervals")
+             .Integer("cycle_start", Interval * Timing.IntervalWidth)
+             .Integer("cycle_end", (Interval + 1) * Timing.IntervalWidth)
+             .Integer("reads", Traffic.Reads)
+             .Integer("writes", Traffic.Writes)
+             .Fraction("bandwidth_gbps", double((Traffic.Reads + Traffic.Writes) * Timing.BlockSize) / double(Timing.IntervalWidth) * Timing.Configuration.ClockGhz);
+      }
    }
-   cout << "o. L2 writebacks:              " << to_string(L2.WriteBackCount) << endl;
-   cout << "p. L2 prefetches:              " << to_string(L2.PrefetchesCount) << endl;
-   cout << "q. memory traffic:             " << to_string(L1.MemoryTraffic + L2.MemoryTraffic) << endl;
+   return Report;
 }
@@ -1,8 +1,16 @@
 
-#define MaxAddressBitSize 32
 #define TagB 1
 #define IndexB 2
 #define OffsetB 3
+#define BlockB 4
+#define CacheValidFlag 0x1
+#define CacheDirtyFlag 0x2
+#define CacheSharedFlag 0x4 // coherent private caches: other caches may hold the block too
+#define HostCacheLineSize 64
+#define LruHead 0
+#define LruTail 1
+#define LruNone 0xffff
+#define LruListMaxEntries 0xffff
 
 #include <vector>
 #include <math.h>
@@ -10,18 +18,138 @@
 #include <iostream>
 #include <bitset>
 #include <array>
+#include <memory>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
 #include <bitset>
+#include <string.h>
+#include "address_width.h"
+#include "tag_match.h"
+#include "checkpoint.h"
+#include "prefetcher.h"
+#include "statistics.h"
+#include "profiler.h"
 
 using namespace std;
 
+#if defined(BLOCK_ADDRESS_REGRESSION) && defined(SIM_ADDRESS_64)
+#error "BLOCK_ADDRESS_REGRESSION checks against the 32-bit legacy computation; build sim_verify without SIM_ADDRESS_64"
+#endif
+
+struct alignas(HostCacheLineSize) CacheSetLine
+{
+   uint8_t Bytes[HostCacheLineSize];
+};
+
+enum ReplacementPolicyType
+{
+   LruPolicy,
+   PlruPolicy,
+   SrripPolicy,
+   BrripPolicy,
+   DrripPolicy,
+   FifoPolicy,
+   RandomPolicy
+};
+
+#define DuelingLeaderSetsPerPolicy 32 // at most
+#define DuelingSetsPerLeader 32       // one leader of each policy per 32 sets, so small caches keep followers
+#define DuelingSelectorMax 1023
+#define DuelingSelectorThreshold 512
+#define RripMaxValue 3
+#define BrripLongInsertionPeriod 32
+
+struct LruReplacement;
+
+// Recency lists link entries MRU -> LRU through Prev/Next; Ends[LruHead] is the MRU entry and
+// Ends[LruTail] the LRU one, so touching an entry and finding the victim are both O(1)
+static inline void LruListReset(uint16_t *Prev, uint16_t *Next, uint16_t *Ends, uint32_t Count)
+{
+   for (uint32_t Entry = 0; Entry < Count; Entry++)
+   {
+      Prev[Entry] = (Entry == 0) ? LruNone : Entry - 1;
+      Next[Entry] = (Entry == Count - 1) ? LruNone : Entry + 1;
+   }
+   Ends[LruHead] = (Count == 0) ? LruNone : 0;
+   Ends[LruTail] = (Count == 0) ? LruNone : Count - 1;
+}
+
+static inline void LruListTouch(uint16_t *Prev, uint16_t *Next, uint16_t *Ends, uint32_t Entry)
+{
+   if (Ends[LruHead] == Entry)
+      return;
+
+   Next[Prev[Entry]] = Next[Entry];
+   if (Next[Entry] != LruNone)
+      Prev[Next[Entry]] = Prev[Entry];
+   else
+      Ends[LruTail] = Prev[Entry];
+
+   Prev[Entry] = LruNone;
+   Next[Entry] = Ends[LruHead];
+   Prev[Ends[LruHead]] = Entry;
+   Ends[LruHead] = Entry;
+}
+
+// Makes Entry the LRU entry
+static inline void LruListDemote(uint16_t *Prev, uint16_t *Next, uint16_t *Ends, uint32_t Entry)
+{
+   if (Ends[LruTail] == Entry)
+      return;
+
+   if (Prev[Entry] != LruNone)
+      Next[Prev[Entry]] = Next[Entry];
+   else
+      Ends[LruHead] = Next[Entry];
+   Prev[Next[Entry]] = Prev[Entry];
+
+   Next[Entry] = LruNone;
+   Prev[Entry] = Ends[LruTail];
+   Next[Ends[LruTail]] = Entry;
+   Ends[LruTail] = Entry;
+}
+
+// The levels below a cache as a compile-time chain: CacheLevel<policy of the next level, the
+// levels below it>, ending in MemoryLevel. Write-backs walk the chain through each module's
+// LowerLevel pointer, so every level is reached with its own policy's inlined code.
+// TimedMemoryLevel is memory for the timing model: the last level also logs each block it
+// reads from or writes to memory as a MemoryRequest.
+struct MemoryLevel
+{
+   static constexpr bool IsMemory = true;
+   static constexpr bool TimedFlag = false;
+};
+
+struct TimedMemoryLevel
+{
+   static constexpr bool IsMemory = true;
+   static constexpr bool TimedFlag = true;
+};
+
+#define MemoryDemandRead 0   // a demand miss, or a write-allocate fetch below the top level
+#define MemoryPrefetchRead 1 // a stream buffer fill
+#define MemoryWriteBack 2
+
+struct MemoryRequest
+{
+   CacheAddress BlockAddress;
+   uint32_t Kind;
+};
+
+template <typename LevelPolicy, typename LevelLower>
+struct CacheLevel
+{
+   static constexpr bool IsMemory = false;
+   typedef LevelPolicy Policy;
+   typedef LevelLower Lower;
+};
+
 class CacheModule
 {
 public:
    // InputParameters
-   uint32_t BLOCKSIZE;
+   uint32_t BLOCKSIZE = 0;
    uint32_t SIZE = 0;
    uint32_t ASSOC;
    uint32_t PREF_N = 0;
@@ -34,33 +162,60 @@ public:
    uint32_t TagOffsetBitCount;
    uint32_t TagAddressPrefetchOffset;
 
+   // AddressDecoding (shift/mask constants derived once from the bit counts)
+   uint32_t TagShift = 0;
+   uint32_t IndexMask = 0;
+   uint32_t BlockOffsetMask = 0;
+   uint64_t BlockAddressSpace = 0;
+
+   // Next level down; unused (NULL) when memory is below
+   CacheModule *LowerLevel = NULL;
+
+   // Memory requests of the current trace record, when memory below is a TimedMemoryLevel
+   vector<MemoryRequest> *MemoryRequests = NULL;
+
    // OutputPerformanceParameters
-   uint32_t ReadCount = 0;
-   uint32_t ReadMissCount = 0;
-   uint32_t ReadPrefetchCount = 0;
-   uint32_t ReadMissPrefetchCount = 0;
-   uint32_t WriteCount = 0;
-   uint32_t WriteMissCount = 0;
-   uint32_t WriteBackCount = 0;
-   uint32_t PrefetchesCount = 0;
-   uint32_t MemoryTraffic = 0;
-
-   // CacheContents
-   vector<vector<bool>> CacheValidBit;
-   vector<vector<bool>> CacheDirtyBit;
-   vector<vector<uint32_t>> CacheTagAddress;
-   vector<vector<uint32_t>> CacheTag;
-   vector<vector<uint32_t>> CacheLruBit;
+   CacheStatistics Statistics;
+
+   // CacheContents: one cache-line-aligned allocation, each set laid out as
+   // [Tag x ASSOC][State x ASSOC][Replacement] so a probe reads tags and state bytes back to back.
+   // The replacement area depends on the policy: LRU keeps [LruPrev x ASSOC][LruNext x ASSOC][LruEnds x 2],
+   // PLRU its tree bits, the RRIP family one RRPV byte per way and FIFO its insertion pointer.
+   vector<CacheSetLine> CacheSets;
+   uint32_t CacheSetLineCount = 0;
+   uint32_t CacheSetStateOffset = 0;
+   uint32_t CacheSetReplacementOffset = 0;
+
+   // ReplacementState
+   uint32_t ReplacementPolicy = LruPolicy;
+   uint64_t ReplacementRandomState = 1;
+   uint32_t DuelingSelector = DuelingSelectorThreshold - 1; // just below: followers start on SRRIP
+   uint32_t DuelingStride = 0;
+
+   // TagMatch compares a whole set or the whole stream buffer at once; null keeps the scalar loops
+   TagMatchKernel CacheTagMatch = NULL;
+   TagMatchKernel PrefetchTagMatch = NULL;
 
    // PrefetchContents
    vector<bool> PrefetchValidBit;
-   vector<vector<uint32_t>> PrefetchTagAddress;
-   vector<uint32_t> PrefetchLruBit;
+   vector<CacheAddress> PrefetchTagAddress; // PREF_N streams of PREF_M block addresses, stream-major
+   vector<uint16_t> PrefetchLruPrev;
+   vector<uint16_t> PrefetchLruNext;
+   uint16_t PrefetchLruEnds[2] = {LruNone, LruNone};
+
+   // SetSampling: under --sample only accesses to sets marked here are simulated; empty otherwise
+   vector<uint8_t> SampledSets;
 
-   CacheModule(uint32_t InputBlockSize, uint32_t InputSize, uint32_t InputAssoc, uint32_t InputPrefetchN, uint32_t InputPrefetchM)
+   // PrefetchEngine: a prefetcher.h engine filling the cache itself, NULL without one
+   unique_ptr<Prefetcher> PrefetchEngine;
+   vector<CacheAddress> PrefetchCandidates;
+
+   CacheModule(uint32_t InputBlockSize, uint32_t InputSize, uint32_t InputAssoc, uint32_t InputPrefetchN, uint32_t InputPrefetchM, uint32_t InputReplacementPolicy = LruPolicy, uint64_t InputReplacementSeed = 1)
    {
       SIZE = InputSize;
       ASSOC = InputAssoc;
+      ReplacementPolicy = InputReplacementPolicy;
+      ReplacementRandomState = InputReplacementSeed ? InputReplacementSeed : 1;
       if (InputSize > 0)
       {
          BLOCKSIZE = InputBlockSize;
@@ -70,37 +225,33 @@ public:
          IndexBitCount = log2(NumberOfSets);
          BlockOffsetBitCount = log2(InputBlockSize);
          TagOffsetBitCount = MaxAddressBitSize - IndexBitCount - BlockOffsetBitCount;
+         TagShift = BlockOffsetBitCount + IndexBitCount;
+         IndexMask = (1u << IndexBitCount) - 1;
+         BlockOffsetMask = (1u << BlockOffsetBitCount) - 1;
+         BlockAddressSpace = (MaxAddressBitSize - BlockOffsetBitCount < 64) ? (1ull << (MaxAddressBitSize - BlockOffsetBitCount)) : UINT64_MAX;
          TagAddressPrefetchOffsetCalculation();
 
          // CacheContents
-         CacheValidBit.resize(NumberOfSets, vector<bool>(ASSOC, false));
-         CacheDirtyBit.resize(NumberOfSets, vector<bool>(ASSOC, false));
-         CacheTagAddress.resize(NumberOfSets, vector<uint32_t>(ASSOC, 0));
-         CacheTag.resize(NumberOfSets, vector<uint32_t>(ASSOC, 0));
-         CacheLruBit.resize(NumberOfSets, vector<uint32_t>(ASSOC, 0));
+         CacheSetStateOffset = ASSOC * sizeof(CacheAddress);
+         CacheSetReplacementOffset = (CacheSetStateOffset + ASSOC + sizeof(uint16_t) - 1) & ~(uint32_t)(sizeof(uint16_t) - 1);
+         CacheSetLineCount = (CacheSetReplacementOffset + CacheSetReplacementBytes() + HostCacheLineSize - 1) / HostCacheLineSize;
+         CacheSets.assign((size_t)NumberOfSets * CacheSetLineCount, CacheSetLine());
          for (uint32_t SetCounter = 0; SetCounter < NumberOfSets; SetCounter++)
-         {
-            for (uint32_t LruCounter = 0; LruCounter < ASSOC; LruCounter++)
-               CacheLruBit[SetCounter][LruCounter] = LruCounter;
-         }
+            ResetReplacementState(SetCounter);
+         if (NumberOfSets >= 2)
+            DuelingStride = NumberOfSets / min(max(NumberOfSets / DuelingSetsPerLeader, 1u), (uint32_t)DuelingLeaderSetsPerPolicy);
+
+         if (ASSOC >= TagMatchVectorThreshold)
+            CacheTagMatch = SelectTagMatchKernel();
+         if (PREF_N * PREF_M >= TagMatchVectorThreshold)
+            PrefetchTagMatch = SelectTagMatchKernel();
 
          // PrefetchContents
          PrefetchValidBit.resize(PREF_N);
-         PrefetchTagAddress.resize(PREF_N, vector<uint32_t>(PREF_M, 0));
-         PrefetchLruBit.resize(PREF_N);
-         for (uint32_t LruCounter = 0; LruCounter < PREF_N; LruCounter++)
-            PrefetchLruBit[LruCounter] = LruCounter;
-
-         // OutputParameters
-         ReadCount = 0;
-         ReadMissCount = 0;
-         ReadPrefetchCount = 0;
-         ReadMissPrefetchCount = 0;
-         WriteCount = 0;
-         WriteMissCount = 0;
-         WriteBackCount = 0;
-         PrefetchesCount = 0;
-         MemoryTraffic = 0;
+         PrefetchTagAddress.assign(PREF_N * PREF_M, 0);
+         PrefetchLruPrev.resize(PREF_N);
+         PrefetchLruNext.resize(PREF_N);
+         LruListReset(PrefetchLruPrev.data(), PrefetchLruNext.data(), PrefetchLruEnds, PREF_N);
       }
    }
 
@@ -108,7 +259,230 @@ public:
    {
    }
 
-   string IntegerTostring(uint32_t IntData, bool SameLengthFlag = false)
+   void ResetReplacementState(uint32_t SetIndex)
+   {
+      memset(CacheSetReplacement(SetIndex), 0, CacheSetReplacementBytes());
+      if (ReplacementPolicy == LruPolicy)
+         LruListReset(CacheSetLruPrev(SetIndex), CacheSetLruNext(SetIndex), CacheSetLruEnds(SetIndex), ASSOC);
+      else if ((ReplacementPolicy == SrripPolicy) || (ReplacementPolicy == BrripPolicy) || (ReplacementPolicy == DrripPolicy))
+         memset(CacheSetReplacement(SetIndex), RripMaxValue, ASSOC);
+   }
+
+   // Checkpoint section: geometry, counters, replacement and stream buffer state, then the set
+   // array on its own aligned boundary
+   void SaveCheckpoint(CheckpointWriter &Checkpoint)
+   {
+      for (uint32_t Parameter : {BLOCKSIZE, SIZE, ASSOC, PREF_N, PREF_M, ReplacementPolicy})
+         Checkpoint.Put(Parameter);
+      if (SIZE == 0)
+         return;
+      Checkpoint.Put(Statistics);
+      Checkpoint.Put(ReplacementRandomState);
+      Checkpoint.Put(DuelingSelector);
+      Checkpoint.Put(CacheSetLineCount);
+      for (uint32_t StreamCounter = 0; StreamCounter < PREF_N; StreamCounter++)
+         Checkpoint.Put((uint8_t)PrefetchValidBit[StreamCounter]);
+      Checkpoint.PutBytes(PrefetchTagAddress.data(), PrefetchTagAddress.size() * sizeof(CacheAddress));
+      Checkpoint.PutBytes(PrefetchLruPrev.data(), PrefetchLruPrev.size() * sizeof(uint16_t));
+      Checkpoint.PutBytes(PrefetchLruNext.data(), PrefetchLruNext.size() * sizeof(uint16_t));
+      Checkpoint.PutBytes(PrefetchLruEnds, sizeof(PrefetchLruEnds));
+      Checkpoint.Align();
+      Checkpoint.PutBytes(CacheSets.data(), CacheSets.size() * sizeof(CacheSetLine));
+   }
+
+   // Restores a section written by a cache of the same BLOCKSIZE, SIZE and ASSOC. Tags, valid and
+   // dirty bits and counters always carry over; replacement state only under the same policy
+   // (otherwise it starts fresh as after construction) and stream buffers only with the same
+   // PREF_N and PREF_M (otherwise they start empty).
+   void LoadCheckpoint(CheckpointReader &Checkpoint)
+   {
+      uint32_t Parameters[6];
+      for (uint32_t &Parameter : Parameters)
+         Parameter = Checkpoint.Get<uint32_t>();
+      if ((Parameters[0] != BLOCKSIZE && SIZE != 0) || (Parameters[1] != SIZE) || (Parameters[2] != ASSOC && SIZE != 0))
+      {
+         cout << "Error: Checkpoint cache " << Parameters[1] << "/" << Parameters[2] << "/" << Parameters[0] << " does not match SIZE/ASSOC/BLOCKSIZE " << SIZE << "/" << ASSOC << "/" << BLOCKSIZE << '\n';
+         exit(EXIT_FAILURE);
+      }
+      if (SIZE == 0)
+         return;
+      bool SamePrefetch = (Parameters[3] == PREF_N) && (Parameters[4] == PREF_M);
+      bool SamePolicy = (Parameters[5] == ReplacementPolicy);
+
+      Statistics = Checkpoint.Get<CacheStatistics>();
+      uint64_t SavedRandomState = Checkpoint.Get<uint64_t>();
+      uint32_t SavedDuelingSelector = Checkpoint.Get<uint32_t>();
+      uint32_t SavedSetLineCount = Checkpoint.Get<uint32_t>();
+      if (SamePolicy)
+      {
+         ReplacementRandomState = SavedRandomState;
+         DuelingSelector = SavedDuelingSelector;
+      }
+
+      const uint8_t *SavedValid = Checkpoint.GetBytes(Parameters[3]);
+      const uint8_t *SavedTags = Checkpoint.GetBytes((size_t)Parameters[3] * Parameters[4] * sizeof(CacheAddress));
+      const uint8_t *SavedPrev = Checkpoint.GetBytes(Parameters[3] * sizeof(uint16_t));
+      const uint8_t *SavedNext = Checkpoint.GetBytes(Parameters[3] * sizeof(uint16_t));
+      const uint8_t *SavedEnds = Checkpoint.GetBytes(sizeof(PrefetchLruEnds));
+      if (SamePrefetch)
+      {
+         for (uint32_t StreamCounter = 0; StreamCounter < PREF_N; StreamCounter++)
+            PrefetchValidBit[StreamCounter] = SavedValid[StreamCounter];
+         memcpy(PrefetchTagAddress.data(), SavedTags, PrefetchTagAddress.size() * sizeof(CacheAddress));
+         memcpy(PrefetchLruPrev.data(), SavedPrev, PrefetchLruPrev.size() * sizeof(uint16_t));
+         memcpy(PrefetchLruNext.data(), SavedNext, PrefetchLruNext.size() * sizeof(uint16_t));
+         memcpy(PrefetchLruEnds, SavedEnds, sizeof(PrefetchLruEnds));
+      }
+
+      Checkpoint.Align();
+      const uint8_t *SavedSets = Checkpoint.GetBytes((size_t)NumberOfSets * SavedSetLineCount * sizeof(CacheSetLine));
+      if (SamePolicy)
+      {
+         memcpy(CacheSets.data(), SavedSets, CacheSets.size() * sizeof(CacheSetLine));
+         return;
+      }
+      // Tags and states sit before the replacement area, at the same offsets for every policy
+      for (uint32_t SetCounter = 0; SetCounter < NumberOfSets; SetCounter++)
+      {
+         memcpy(CacheSetTag(SetCounter), SavedSets + (size_t)SetCounter * SavedSetLineCount * sizeof(CacheSetLine), CacheSetReplacementOffset);
+         ResetReplacementState(SetCounter);
+      }
+   }
+
+   void ResetStatistics()
+   {
+      Statistics = CacheStatistics();
+   }
+
+   // Marks the sets whose low SampleBitCount index bits select a sampled class
+   void SampleSets(const vector<uint8_t> &SampledClasses, uint32_t SampleBitCount)
+   {
+      SampledSets.resize(NumberOfSets);
+      for (uint32_t SetCounter = 0; SetCounter < NumberOfSets; SetCounter++)
+         SampledSets[SetCounter] = SampledClasses[SetCounter & ((1u << SampleBitCount) - 1)];
+   }
+
+   // Scales the counters of a set-sampled run up to the whole cache
+   void ScaleStatistics(double Scale)
+   {
+      Statistics.Scale(Scale);
+      if (PrefetchEngine)
+         PrefetchEngine->ScaleStatistics(Scale);
+   }
+
+   CacheAddress *CacheSetTag(uint32_t SetIndex)
+   {
+      return (CacheAddress *)CacheSets[(size_t)SetIndex * CacheSetLineCount].Bytes;
+   }
+
+   uint8_t *CacheSetState(uint32_t SetIndex)
+   {
+      return CacheSets[(size_t)SetIndex * CacheSetLineCount].Bytes + CacheSetStateOffset;
+   }
+
+   // Host prefetch of the lines of the set Address maps to, ahead of its lookup. Only a hint to
+   // the host: the cache state is untouched. Always inlined, as GCC drops calls to a function
+   // whose only effect is a prefetch.
+   __attribute__((always_inline)) void PrefetchSet(CacheAddress Address) const
+   {
+      const CacheSetLine *Set = &CacheSets[(size_t)((Address >> BlockOffsetBitCount) & IndexMask) * CacheSetLineCount];
+      for (uint32_t Line = 0; Line < CacheSetLineCount; Line++)
+         __builtin_prefetch(Set + Line, 1);
+   }
+
+   uint32_t CacheSetReplacementBytes()
+   {
+      switch (ReplacementPolicy)
+      {
+      case LruPolicy:
+         return (2 * ASSOC + 2) * sizeof(uint16_t);
+      case PlruPolicy:
+         return ASSOC / 8 + 1;
+      case SrripPolicy:
+      case BrripPolicy:
+      case DrripPolicy:
+         return ASSOC;
+      case FifoPolicy:
+         return sizeof(uint16_t);
+      default:
+         return 0;
+      }
+   }
+
+   uint8_t *CacheSetReplacement(uint32_t SetIndex)
+   {
+      return CacheSets[(size_t)SetIndex * CacheSetLineCount].Bytes + CacheSetReplacementOffset;
+   }
+
+   uint16_t *CacheSetLruPrev(uint32_t SetIndex)
+   {
+      return (uint16_t *)CacheSetReplacement(SetIndex);
+   }
+
+   uint16_t *CacheSetLruNext(uint32_t SetIndex)
+   {
+      return CacheSetLruPrev(SetIndex) + ASSOC;
+   }
+
+   uint16_t *CacheSetLruEnds(uint32_t SetIndex)
+   {
+      return CacheSetLruPrev(SetIndex) + 2 * ASSOC;
+   }
+
+   CacheAddress *PrefetchStream(uint32_t StreamIndex)
+   {
+      return PrefetchTagAddress.data() + StreamIndex * PREF_M;
+   }
+
+   uint32_t FirstInvalidWay(uint32_t SetIndex)
+   {
+      uint8_t *SetState = CacheSetState(SetIndex);
+      for (uint32_t Way = 0; Way < ASSOC; Way++)
+      {
+         if (!(SetState[Way] & CacheValidFlag))
+            return Way;
+      }
+      return ASSOC;
+   }
+
+   // xorshift64* over ReplacementRandomState; Peek leaves the state alone, Next advances it
+   uint64_t PeekReplacementRandom()
+   {
+      uint64_t RandomState = ReplacementRandomState;
+      RandomState ^= RandomState >> 12;
+      RandomState ^= RandomState << 25;
+      RandomState ^= RandomState >> 27;
+      return (RandomState * 0x2545F4914F6CDD1Dull) >> 32;
+   }
+
+   uint64_t NextReplacementRandom()
+   {
+      uint64_t RandomValue = PeekReplacementRandom();
+      ReplacementRandomState ^= ReplacementRandomState >> 12;
+      ReplacementRandomState ^= ReplacementRandomState << 25;
+      ReplacementRandomState ^= ReplacementRandomState >> 27;
+      return RandomValue;
+   }
+
+   // DRRIP leader group of a set: SrripPolicy, BrripPolicy, or DrripPolicy for follower sets
+   uint32_t DuelingLeader(uint32_t SetIndex)
+   {
+      if (DuelingStride == 0)
+         return DrripPolicy;
+      if (SetIndex % DuelingStride == 0)
+         return SrripPolicy;
+      if (SetIndex % DuelingStride == DuelingStride - 1)
+         return BrripPolicy;
+      return DrripPolicy;
+   }
+
+   // Block address held by a way, rebuilt from its tag and the set it lives in
+   CacheAddress CacheBlockAddress(uint32_t SetIndex, uint32_t Way)
+   {
+      return (CacheAddress)(((uint64_t)CacheSetTag(SetIndex)[Way] << IndexBitCount) | SetIndex);
+   }
+
+   string IntegerTostring(CacheAddress IntData, bool SameLengthFlag = false)
    {
       ostringstream ss;
       if (SameLengthFlag)
@@ -118,25 +492,47 @@ public:
       return ss.str();
    }
 
-   array<uint32_t, 4> GetTagParameters(uint32_t TagData)
+   array<CacheAddress, 5> GetTagParameters(CacheAddress TagData)
    {
-      array<uint32_t, 4> TagIndividualDataBits;
-      string TagDataBinary = bitset<32>(TagData).to_string();
+      ProfileRegion(ProfileGetTagParameters);
+      array<CacheAddress, 5> TagIndividualDataBits;
       TagIndividualDataBits[0] = TagData;
-      TagIndividualDataBits[TagB] = stoull(TagDataBinary.substr(0, TagOffsetBitCount), 0, 2);
-      try
-      {
-         TagIndividualDataBits[IndexB] = stoull(TagDataBinary.substr(MaxAddressBitSize - IndexBitCount - BlockOffsetBitCount, IndexBitCount), 0, 2);
-      }
-      catch (const std::exception &e)
-      {
-         TagIndividualDataBits[IndexB] = stoull("0", 0, 2);
-      }
-      TagIndividualDataBits[OffsetB] = stoull(TagDataBinary.substr(MaxAddressBitSize - BlockOffsetBitCount, BlockOffsetBitCount), 0, 2);
+      TagIndividualDataBits[TagB] = (TagShift < MaxAddressBitSize) ? (TagData >> TagShift) : 0;
+      TagIndividualDataBits[IndexB] = (TagData >> BlockOffsetBitCount) & IndexMask;
+      TagIndividualDataBits[OffsetB] = TagData & BlockOffsetMask;
+      TagIndividualDataBits[BlockB] = TagData >> BlockOffsetBitCount;
       return TagIndividualDataBits;
    }
 
-   uint32_t TagAddressCalculation(uint32_t AddressTag, uint32_t AddressIndex, uint32_t AddressBlock = 0)
+   // Block address (address >> BlockOffsetBitCount) of tag/index, where an index past the last set carries into the tag.
+   // A carry out of the tag keeps only the index bits, matching LegacyTagAddressCalculation.
+   CacheAddress TagAddressCalculation(CacheAddress AddressTag, uint32_t AddressIndex, uint32_t AddressBlock = 0)
+   {
+      uint64_t ResultTagAddress = ((uint64_t)AddressTag << IndexBitCount) + AddressIndex;
+      if (ResultTagAddress >= BlockAddressSpace)
+         ResultTagAddress &= IndexMask;
+
+#ifdef BLOCK_ADDRESS_REGRESSION
+      BlockAddressRegression((uint32_t)ResultTagAddress, AddressTag, AddressIndex);
+#endif
+      return (CacheAddress)ResultTagAddress;
+   }
+
+   // Block address Distance blocks after BlockAddress, the increment used to fill and look up stream buffers
+   CacheAddress BlockAddressOffset(CacheAddress BlockAddress, uint32_t Distance)
+   {
+      uint64_t ResultTagAddress = (uint64_t)BlockAddress + Distance;
+      if (ResultTagAddress >= BlockAddressSpace)
+         ResultTagAddress &= IndexMask;
+
+#ifdef BLOCK_ADDRESS_REGRESSION
+      BlockAddressRegression((uint32_t)ResultTagAddress, BlockAddress >> IndexBitCount, (BlockAddress & IndexMask) + Distance);
+#endif
+      return (CacheAddress)ResultTagAddress;
+   }
+
+#ifdef BLOCK_ADDRESS_REGRESSION
+   uint32_t LegacyTagAddressCalculation(uint32_t AddressTag, uint32_t AddressIndex)
    {
       if (AddressIndex >= pow(2, IndexBitCount))
       {
@@ -152,174 +548,313 @@ public:
 
       string TagBinary = bitset<32>(AddressTag).to_string().substr(32 - TagOffsetBitCount);
       string IndexBinary = bitset<32>(AddressIndex).to_string().substr(32 - IndexBitCount);
-      string BlockBinary = bitset<32>(0).to_string().substr(32 - BlockOffsetBitCount);
-      uint32_t ResultTagAddress = stoull(TagBinary + IndexBinary, 0, 2);
+      return stoull(TagBinary + IndexBinary, 0, 2);
+   }
 
-      return ResultTagAddress;
+   void BlockAddressRegression(uint32_t BlockAddress, uint32_t AddressTag, uint32_t AddressIndex)
+   {
+      uint32_t LegacyBlockAddress = LegacyTagAddressCalculation(AddressTag, AddressIndex);
+      if (BlockAddress != LegacyBlockAddress)
+      {
+         cout << "Error: Block address mismatch for tag " << IntegerTostring(AddressTag) << " index " << IntegerTostring(AddressIndex) << ": " << IntegerTostring(BlockAddress) << " != legacy " << IntegerTostring(LegacyBlockAddress) << '\n';
+         exit(EXIT_FAILURE);
+      }
    }
+#endif
 
    void TagAddressPrefetchOffsetCalculation()
    {
       TagAddressPrefetchOffset = (TagAddressCalculation(0, 1) - TagAddressCalculation(0, 0));
    }
 
-   bool CacheMiss(uint32_t TagData)
+   // Way holding a valid copy of the block, or ASSOC when the block is absent
+   uint32_t CacheHitWay(const array<CacheAddress, 5> &TagIndividualDataBits)
+   {
+      CacheAddress *SetTag = CacheSetTag(TagIndividualDataBits[IndexB]);
+      uint8_t *SetState = CacheSetState(TagIndividualDataBits[IndexB]);
+      if (CacheTagMatch)
+      {
+         for (uint32_t WayBase = 0; WayBase < ASSOC; WayBase += TagMatchKernelWidth)
+         {
+            uint64_t MatchMask = CacheTagMatch(SetTag + WayBase, min(ASSOC - WayBase, (uint32_t)TagMatchKernelWidth), TagIndividualDataBits[TagB]);
+            for (; MatchMask; MatchMask &= MatchMask - 1) // invalid ways may still hold a stale matching tag
+            {
+               if (SetState[WayBase + __builtin_ctzll(MatchMask)] & CacheValidFlag)
+                  return WayBase + __builtin_ctzll(MatchMask);
+            }
+         }
+         return ASSOC;
+      }
+
+      for (uint32_t AssociativitySearch = 0; AssociativitySearch < ASSOC; AssociativitySearch++)
+      {
+         if ((SetTag[AssociativitySearch] == TagIndividualDataBits[TagB]) && (SetState[AssociativitySearch] & CacheValidFlag))
+            return AssociativitySearch;
+      }
+      return ASSOC;
+   }
+
+   bool CacheMiss(const array<CacheAddress, 5> &TagIndividualDataBits)
    {
+      ProfileRegion(ProfileCacheMiss);
       if (SIZE == 0)
          return true;
 
-      array<uint32_t, 4> TagIndividualDataBits = GetTagParameters(TagData);
-      for (uint32_t AssociativitySearch = 0; AssociativitySearch < ASSOC; AssociativitySearch++)
+      return CacheHitWay(TagIndividualDataBits) == ASSOC;
+   }
+
+   // Position of Tag in Tags[0..Count), or Count when absent
+   uint32_t FirstTagMatch(TagMatchKernel TagMatch, const CacheAddress *Tags, uint32_t Count, CacheAddress Tag)
+   {
+      for (uint32_t TagBase = 0; TagBase < Count; TagBase += TagMatchKernelWidth)
       {
-         if ((CacheTag[TagIndividualDataBits[IndexB]][AssociativitySearch] == TagIndividualDataBits[TagB]) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativitySearch]))
-            return false;
+         uint64_t MatchMask = TagMatch(Tags + TagBase, min(Count - TagBase, (uint32_t)TagMatchKernelWidth), Tag);
+         if (MatchMask)
+            return TagBase + __builtin_ctzll(MatchMask);
       }
-      return true;
+      return Count;
    }
 
-   void CacheDirtyBitEviction(uint32_t TagData, CacheModule &LowerCache, CacheModule &LowerCache1)
+   template <typename LowerChain>
+   void LogMemoryRequest(CacheAddress BlockAddress, uint32_t Kind)
    {
-      array<uint32_t, 4> TagIndividualDataBits = GetTagParameters(TagData);
-   
-      for (uint32_t AssociativitySearch = 0; AssociativitySearch < ASSOC; AssociativitySearch++)
+      if constexpr (LowerChain::TimedFlag)
+         MemoryRequests->push_back({BlockAddress, Kind});
+   }
+
+   // Writes a dirty block back to the next level (allocating it there) or counts it as memory traffic
+   template <typename LowerChain>
+   void WriteBackBlock(CacheAddress BlockAddress)
+   {
+      if constexpr (!LowerChain::IsMemory)
       {
-         if (((CacheLruBit[TagIndividualDataBits[IndexB]][AssociativitySearch]) == (ASSOC - 1)) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativitySearch]) && ((CacheTagAddress[TagIndividualDataBits[IndexB]][AssociativitySearch]) != TagData) && (CacheDirtyBit[TagIndividualDataBits[IndexB]][AssociativitySearch]))
-         {
-            TagIndividualDataBits = GetTagParameters((CacheTagAddress[TagIndividualDataBits[IndexB]][AssociativitySearch]));
-            if ((CacheDirtyBit[TagIndividualDataBits[IndexB]][AssociativitySearch]) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativitySearch])) // check if valid = 1 and dirty = 1
-            {
-               if (LowerCache.SIZE != 0)
-               {
-                  bool UpdatePrefetchFlag = true;
-                  uint32_t TagData = CacheTagAddress[TagIndividualDataBits[IndexB]][AssociativitySearch];
-                  if (!(LowerCache.CacheMiss(TagData)))
-                  { // L2 Hit
-                     if (LowerCache.PrefetchMiss(TagData))
-                        UpdatePrefetchFlag = false;
-                  }
-                  LowerCache.UpdateCacheContents(TagData, true, LowerCache1, LowerCache1, UpdatePrefetchFlag, false, false, true);
-                  LowerCache.WriteCount += 1;
-               }
-               else
-                  MemoryTraffic += 1;
-               CacheDirtyBit[TagIndividualDataBits[IndexB]][AssociativitySearch] = false;
-               WriteBackCount += 1;
-               return;
-            }
+         CacheModule &LowerCache = *LowerLevel;
+         bool UpdatePrefetchFlag = true;
+         array<CacheAddress, 5> LowerDataBits = LowerCache.GetTagParameters(BlockAddress << BlockOffsetBitCount);
+         if (!(LowerCache.CacheMiss(LowerDataBits)))
+         { // L2 Hit
+            if (LowerCache.PrefetchMiss(LowerDataBits))
+               UpdatePrefetchFlag = false;
          }
+         LowerCache.template UpdateCacheContents<typename LowerChain::Policy, typename LowerChain::Lower>(LowerDataBits, true, UpdatePrefetchFlag, false, false, true);
+         LowerCache.Statistics.WriteCount += 1;
+      }
+      else
+      {
+         Statistics.MemoryTraffic += 1;
+         Statistics.MemoryWriteBackCount += 1;
+         LogMemoryRequest<LowerChain>(BlockAddress, MemoryWriteBack);
       }
+      Statistics.WriteBackCount += 1;
    }
 
-   void UpdateCacheContents(uint32_t TagData, bool WriteFlag, CacheModule &LowerCache, CacheModule &LowerCache1, bool UpdatePrefetchFlag, bool Iteration = false, bool MaskCacheLruUpdate = false, bool EvictionFlag = false)
+   // Fetches a block this level does not hold from the next level down, which counts the read
+   // and allocates the block like any read; with memory below it is one block of memory traffic
+   template <typename LowerChain>
+   void FetchBlock(CacheAddress BlockAddress, bool PrefetchFlag)
    {
-      if (SIZE == 0)
-         return;
+      if constexpr (LowerChain::IsMemory)
+      {
+         Statistics.MemoryTraffic += 1;
+         LogMemoryRequest<LowerChain>(BlockAddress, PrefetchFlag ? MemoryPrefetchRead : MemoryDemandRead);
+      }
+      else
+         LowerLevel->template ReadBlock<typename LowerChain::Policy, typename LowerChain::Lower>(BlockAddress, PrefetchFlag);
+   }
 
-      array<uint32_t, 4> TagIndividualDataBits = GetTagParameters(TagData);
+   // A read arriving from the level above: a fetch on its behalf (demand or prefetch), never a
+   // write-back. Misses are fetched from further down before the block is allocated here.
+   template <typename Policy, typename LowerChain>
+   void ReadBlock(CacheAddress BlockAddress, bool PrefetchFlag)
+   {
+      array<CacheAddress, 5> DataBits = GetTagParameters(BlockAddress << BlockOffsetBitCount);
+      bool BlockCacheMiss = CacheMiss(DataBits);
+      bool BlockPrefetchMiss = PrefetchMiss(DataBits);
+      if (PrefetchFlag)
+         Statistics.ReadPrefetchCount += 1;
+      else
+         Statistics.ReadCount += 1;
+      if (BlockCacheMiss && BlockPrefetchMiss)
+      {
+         if (PrefetchFlag)
+            Statistics.ReadMissPrefetchCount += 1;
+         else
+            Statistics.ReadMissCount += 1;
+         FetchBlock<LowerChain>(BlockAddress, PrefetchFlag);
+      }
+      else if (BlockCacheMiss && !PrefetchFlag)
+         Statistics.PrefetchHitCount += 1;
+      // Prefetch reads do not train this level's own stream buffers or engine
+      UpdateCacheContents<Policy, LowerChain>(DataBits, false, !PrefetchFlag && (BlockCacheMiss || !BlockPrefetchMiss));
+      if (!PrefetchFlag && PrefetchEngine)
+         TrainPrefetchEngine<Policy, LowerChain>(BlockAddress, BlockCacheMiss, BlockCacheMiss && BlockPrefetchMiss);
+   }
 
-      vector<uint32_t> CacheLruOrderSearch;
-      CacheLruOrderSearch.resize(ASSOC);
-      for (uint32_t i = 0; i < ASSOC; i++)
+   // A demand miss that the stream buffers cannot supply either. The next level counts a read and
+   // fetches the block from further down when it misses too, this level's victim is written back
+   // into it, and then both levels allocate or touch the block; with memory below, the block is
+   // one block of memory traffic.
+   template <typename Policy, typename LowerChain>
+   void DemandFill(const array<CacheAddress, 5> &TagIndividualDataBits, bool WriteFlag)
+   {
+      if constexpr (LowerChain::IsMemory)
       {
-         for (uint32_t ii = 0; ii < ASSOC; ii++)
+         Statistics.MemoryTraffic += 1;
+         LogMemoryRequest<LowerChain>(TagIndividualDataBits[BlockB], MemoryDemandRead);
+         CacheDirtyBitEviction<Policy, LowerChain>(TagIndividualDataBits);
+      }
+      else
+      {
+         CacheModule &LowerCache = *LowerLevel;
+         LowerCache.Statistics.ReadCount += 1;
+         array<CacheAddress, 5> LowerDataBits = LowerCache.GetTagParameters(TagIndividualDataBits[BlockB] << BlockOffsetBitCount);
+         bool LowerCacheMiss = LowerCache.CacheMiss(LowerDataBits);
+         bool LowerPrefetchMiss = LowerCache.PrefetchMiss(LowerDataBits);
+         if (LowerCacheMiss && LowerPrefetchMiss)
          {
-            if (CacheLruBit[TagIndividualDataBits[IndexB]][ii] == i)
-            {
-               CacheLruOrderSearch[i] = ii;
-               break;
-            }
+            LowerCache.Statistics.ReadMissCount += 1;
+            LowerCache.template FetchBlock<typename LowerChain::Lower>(LowerDataBits[BlockB], false);
          }
+         else if (LowerCacheMiss)
+            LowerCache.Statistics.PrefetchHitCount += 1;
+         CacheDirtyBitEviction<Policy, LowerChain>(TagIndividualDataBits);
+         // A hit in the next level that its stream buffers did not supply leaves them alone
+         LowerCache.template UpdateCacheContents<typename LowerChain::Policy, typename LowerChain::Lower>(LowerDataBits, false, LowerCacheMiss || !LowerPrefetchMiss);
+         if (LowerCache.PrefetchEngine)
+            LowerCache.template TrainPrefetchEngine<typename LowerChain::Policy, typename LowerChain::Lower>(LowerDataBits[BlockB], LowerCacheMiss, LowerCacheMiss && LowerPrefetchMiss);
       }
+      UpdateCacheContents<Policy, LowerChain>(TagIndividualDataBits, WriteFlag, true);
+   }
 
-   Position1:
-      for (uint32_t CacheAssociativitySearch = 0; CacheAssociativitySearch < ASSOC; CacheAssociativitySearch++)
+   // After a demand access to this level: the engine accounts and learns from it, and the blocks
+   // it asks for that this level holds in neither the cache nor the stream buffers are read from
+   // the next level down and filled into the cache
+   template <typename Policy, typename LowerChain>
+   void TrainPrefetchEngine(CacheAddress BlockAddress, bool CacheMissFlag, bool DemandMissFlag)
+   {
+      Prefetcher &Engine = *PrefetchEngine;
+      bool PrefetchHitFlag = Engine.DemandAccess(BlockAddress, CacheMissFlag);
+      PrefetchCandidates.clear();
+      Engine.Train(BlockAddress, DemandMissFlag, PrefetchHitFlag, PrefetchCandidates);
+      for (CacheAddress Candidate : PrefetchCandidates)
       {
-         uint32_t AssociativityLruSearch = CacheLruOrderSearch[CacheAssociativitySearch];
-         if (((CacheTag[TagIndividualDataBits[IndexB]][AssociativityLruSearch] == TagIndividualDataBits[TagB]) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch])) || (((CacheLruBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch]) == (ASSOC - 1)) && (!MaskCacheLruUpdate)))
+         if (Candidate >= BlockAddressSpace)
+            continue;
+         array<CacheAddress, 5> DataBits = GetTagParameters(Candidate << BlockOffsetBitCount);
+         if (!SampledSets.empty() && !SampledSets[DataBits[IndexB]])
+            continue;
+         if (!CacheMiss(DataBits) || !PrefetchMiss(DataBits))
          {
-            if ((CacheDirtyBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch]) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch]) && (CacheTag[TagIndividualDataBits[IndexB]][AssociativityLruSearch] == TagIndividualDataBits[TagB]))
-            { // Cache Hit
-               CacheTagAddress[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = TagData;
-               CacheTag[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = TagIndividualDataBits[TagB];
-               CacheValidBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = true;
-
-               if (!MaskCacheLruUpdate)
-                  UpdateCacheLRU(TagData, AssociativityLruSearch);
-               if (UpdatePrefetchFlag)
-                  UpdatePrefetchContents(TagData, WriteFlag);
-               return;
-            }
-            else if (!((CacheDirtyBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch]) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch]))) // check if ValidBit != 1 or DirtyBit != 1
-            {                                                                                                                                                             // Cache Miss
-               if ((EvictionFlag) && (CacheTag[TagIndividualDataBits[IndexB]][AssociativityLruSearch] != TagIndividualDataBits[TagB]) && PrefetchMiss(TagData))
-               {
-                  if (WriteFlag)
-                     WriteMissCount += 1;
-                  else
-                     ReadMissCount += 1;
-                  MemoryTraffic += 1;
-               }
-
-               CacheTagAddress[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = TagData;
-               CacheTag[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = TagIndividualDataBits[TagB];
-               CacheValidBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = true;
-               CacheDirtyBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = WriteFlag;
+            Engine.RedundantCount += 1;
+            continue;
+         }
+         Statistics.PrefetchesCount += 1;
+         Engine.Issue(Candidate, NumberOfSets * ASSOC, [this](CacheAddress Block)
+                      { return !CacheMiss(GetTagParameters(Block << BlockOffsetBitCount)); });
+         FetchBlock<LowerChain>(Candidate, true);
+         CacheDirtyBitEviction<Policy, LowerChain>(DataBits);
+         UpdateCacheContents<Policy, LowerChain>(DataBits, false, false);
+      }
+   }
 
-               // if (LowerCache.SIZE == 0)
-               //  MemoryTraffic += 1;
+   // Drops the block from its way, which becomes the next victim under LRU; returns the state
+   // the block had, 0 when it was not cached
+   uint8_t InvalidateBlock(const array<CacheAddress, 5> &TagIndividualDataBits)
+   {
+      uint32_t Way = CacheHitWay(TagIndividualDataBits);
+      if (Way == ASSOC)
+         return 0;
+      uint8_t *SetState = CacheSetState(TagIndividualDataBits[IndexB]);
+      uint8_t State = SetState[Way];
+      SetState[Way] = 0;
+      if (ReplacementPolicy == LruPolicy)
+         LruListDemote(CacheSetLruPrev(TagIndividualDataBits[IndexB]), CacheSetLruNext(TagIndividualDataBits[IndexB]), CacheSetLruEnds(TagIndividualDataBits[IndexB]), Way);
+      return State;
+   }
 
-               if (!MaskCacheLruUpdate)
-                  UpdateCacheLRU(TagData, AssociativityLruSearch);
-               if (UpdatePrefetchFlag)
-                  UpdatePrefetchContents(TagData, WriteFlag);
-               return;
-            }
-            else if (!Iteration)
-            {
-               Iteration = true;
-               if (LowerCache.SIZE != 0)
-               {
-                  // LowerCache.UpdateCacheContents(CacheTagAddress[TagIndividualDataBits[IndexB]][AssociativityLruSearch], true, LowerCache1, LowerCache1, UpdatePrefetchFlag, Iteration, false, true);
-                  // LowerCache.WriteCount += 1;
-               }
-               else
-                  MemoryTraffic += 1;
-               WriteBackCount += 1;
+   template <typename Policy = LruReplacement, typename LowerChain = MemoryLevel>
+   void CacheDirtyBitEviction(const array<CacheAddress, 5> &TagIndividualDataBits)
+   {
+      ProfileRegion(ProfileCacheDirtyBitEviction);
+      uint8_t *SetState = CacheSetState(TagIndividualDataBits[IndexB]);
+      uint32_t AssociativitySearch = Policy::Victim(*this, TagIndividualDataBits[IndexB]);
 
-               CacheDirtyBit[TagIndividualDataBits[IndexB]][AssociativityLruSearch] = false;
-               goto Position1;
-            }
-         }
+      // Only the policy's victim can be evicted; the victim shares this set, so its decoded index is the one already in hand
+      if ((SetState[AssociativitySearch] & CacheValidFlag) && ((CacheBlockAddress(TagIndividualDataBits[IndexB], AssociativitySearch)) != TagIndividualDataBits[BlockB]) && (SetState[AssociativitySearch] & CacheDirtyFlag))
+      {
+         WriteBackBlock<LowerChain>(CacheBlockAddress(TagIndividualDataBits[IndexB], AssociativitySearch));
+         SetState[AssociativitySearch] &= ~CacheDirtyFlag;
       }
    }
 
-   void UpdateCacheLRU(uint32_t TagData, uint32_t AssociativityReference = 0xffffffff)
+   template <typename Policy = LruReplacement, typename LowerChain = MemoryLevel>
+   void UpdateCacheContents(const array<CacheAddress, 5> &TagIndividualDataBits, bool WriteFlag, bool UpdatePrefetchFlag, bool Iteration = false, bool MaskCacheLruUpdate = false, bool EvictionFlag = false)
    {
+      ProfileRegion(ProfileUpdateCacheContents);
       if (SIZE == 0)
          return;
-      array<uint32_t, 4> TagIndividualDataBits = GetTagParameters(TagData);
-      uint32_t CacheLruReference = 0;
 
-      if (AssociativityReference == 0xffffffff)
+      CacheAddress *SetTag = CacheSetTag(TagIndividualDataBits[IndexB]);
+      uint8_t *SetState = CacheSetState(TagIndividualDataBits[IndexB]);
+
+      // The way holding the block on a hit, otherwise the policy's victim
+      uint32_t AssociativityLruSearch = CacheHitWay(TagIndividualDataBits);
+      bool CacheHitFlag = (AssociativityLruSearch != ASSOC);
+      if (!CacheHitFlag)
       {
-         AssociativityReference = ASSOC - 1;
-         for (uint32_t AssociativitySearch = 0; AssociativitySearch < ASSOC; AssociativitySearch++)
+         if (MaskCacheLruUpdate)
+            return;
+         AssociativityLruSearch = Policy::Victim(*this, TagIndividualDataBits[IndexB]);
+      }
+
+   Position1:
+      if ((SetState[AssociativityLruSearch] & CacheDirtyFlag) && (SetState[AssociativityLruSearch] & CacheValidFlag) && (SetTag[AssociativityLruSearch] == TagIndividualDataBits[TagB]))
+      { // Cache Hit
+         SetTag[AssociativityLruSearch] = TagIndividualDataBits[TagB];
+         SetState[AssociativityLruSearch] |= CacheValidFlag;
+
+         if (!MaskCacheLruUpdate)
+            Policy::Touch(*this, TagIndividualDataBits[IndexB], AssociativityLruSearch);
+         if (UpdatePrefetchFlag)
+            UpdatePrefetchContents<LowerChain>(TagIndividualDataBits, WriteFlag);
+         return;
+      }
+      else if (!((SetState[AssociativityLruSearch] & CacheDirtyFlag) && (SetState[AssociativityLruSearch] & CacheValidFlag))) // check if ValidBit != 1 or DirtyBit != 1
+      {                                                                                                                                                             // Cache Miss
+         if ((EvictionFlag) && (SetTag[AssociativityLruSearch] != TagIndividualDataBits[TagB]) && PrefetchMiss(TagIndividualDataBits))
          {
-            if (((CacheTagAddress[TagIndividualDataBits[IndexB]][AssociativitySearch]) == TagData) && (CacheValidBit[TagIndividualDataBits[IndexB]][AssociativitySearch]))
-            {
-               AssociativityReference = AssociativitySearch;
-               break;
-            }
+            if (WriteFlag)
+               Statistics.WriteMissCount += 1;
+            else
+               Statistics.ReadMissCount += 1;
+            FetchBlock<LowerChain>(TagIndividualDataBits[BlockB], false);
          }
-      }
 
-      CacheLruReference = CacheLruBit[TagIndividualDataBits[IndexB]][AssociativityReference];
-      for (uint32_t AssociativitySearch = 0; AssociativitySearch < ASSOC; AssociativitySearch++)
+         SetTag[AssociativityLruSearch] = TagIndividualDataBits[TagB];
+         SetState[AssociativityLruSearch] = CacheValidFlag | (WriteFlag ? CacheDirtyFlag : 0);
+
+         // if (LowerCache.SIZE == 0)
+         //  Statistics.MemoryTraffic += 1;
+
+         if (MaskCacheLruUpdate)
+         {
+         }
+         else if (CacheHitFlag)
+            Policy::Touch(*this, TagIndividualDataBits[IndexB], AssociativityLruSearch);
+         else
+            Policy::Insert(*this, TagIndividualDataBits[IndexB], AssociativityLruSearch);
+         if (UpdatePrefetchFlag)
+            UpdatePrefetchContents<LowerChain>(TagIndividualDataBits, WriteFlag);
+         return;
+      }
+      else if (!Iteration)
       {
-         if (CacheLruBit[TagIndividualDataBits[IndexB]][AssociativitySearch] < CacheLruReference)
-            CacheLruBit[TagIndividualDataBits[IndexB]][AssociativitySearch]++;
+         Iteration = true;
+         WriteBackBlock<LowerChain>(CacheBlockAddress(TagIndividualDataBits[IndexB], AssociativityLruSearch));
+
+         SetState[AssociativityLruSearch] &= ~CacheDirtyFlag;
+         goto Position1;
       }
-      CacheLruBit[TagIndividualDataBits[IndexB]][AssociativityReference] = 0;
    }
 
    void CacheOutputDisplay(string L1L2)
@@ -332,25 +867,15 @@ public:
 
       for (uint32_t SetSearch = 0; SetSearch < NumberOfSets; SetSearch++)
       {
-         vector<uint32_t> CacheAssocLruOrder;
-         CacheAssocLruOrder.resize(ASSOC);
-         for (uint32_t i = 0; i < ASSOC; i++)
-         {
-            for (uint32_t ii = 0; ii < ASSOC; ii++)
-            {
-               if (CacheLruBit[SetSearch][ii] == i)
-               {
-                  CacheAssocLruOrder[i] = ii;
-                  break;
-               }
-            }
-         }
+         CacheAddress *SetTag = CacheSetTag(SetSearch);
+         uint8_t *SetState = CacheSetState(SetSearch);
+         // LRU sets print MRU first; the other policies keep no total order and print in way order
+         bool LruOrderFlag = (ReplacementPolicy == LruPolicy);
+         uint16_t *SetLruNext = CacheSetLruNext(SetSearch);
          bool InitialFlag = true;
-         for (uint32_t AssocSearch = 0; AssocSearch < ASSOC; AssocSearch++)
+         for (uint32_t AssocOrder = LruOrderFlag ? CacheSetLruEnds(SetSearch)[LruHead] : 0; (AssocOrder != LruNone) && (AssocOrder < ASSOC); AssocOrder = LruOrderFlag ? SetLruNext[AssocOrder] : AssocOrder + 1)
          {
-            uint32_t AssocOrder = CacheAssocLruOrder[AssocSearch];
-
-            if (CacheValidBit[SetSearch][AssocOrder])
+            if (SetState[AssocOrder] & CacheValidFlag)
             {
                if (InitialFlag)
                {
@@ -358,9 +883,9 @@ public:
                        << "set      " << to_string(SetSearch) << ": ";
                   InitialFlag = false;
                }
-               cout << "  " << IntegerTostring(CacheTag[SetSearch][AssocOrder], !true) << " ";
+               cout << "  " << IntegerTostring(SetTag[AssocOrder], !true) << " ";
 
-               if (CacheDirtyBit[SetSearch][AssocOrder])
+               if (SetState[AssocOrder] & CacheDirtyFlag)
                   cout << "D";
                else
                   cout << " ";
@@ -373,119 +898,125 @@ public:
       }
    }
 
-   bool PrefetchMiss(uint32_t TagData)
+   bool PrefetchMiss(const array<CacheAddress, 5> &TagIndividualDataBits)
    {
+      ProfileRegion(ProfilePrefetchMiss);
       if (SIZE == 0)
          return true;
 
-      array<uint32_t, 4> TagIndividualDataBits = GetTagParameters(TagData);
-      uint32_t ReferenceTagAddress = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB]);
+      CacheAddress ReferenceTagAddress = TagIndividualDataBits[BlockB];
 
       /*for (uint32_t PrefetchN = 0; PrefetchN < PREF_N; PrefetchN++)
       {
-         if (((ReferenceTagAddress - PrefetchTagAddress[PrefetchN][0]) < (PREF_M * TagAddressPrefetchOffset)) && (PrefetchValidBit[PrefetchN] == true))
+         if (((ReferenceTagAddress - PrefetchStream(PrefetchN)[0]) < (PREF_M * TagAddressPrefetchOffset)) && (PrefetchValidBit[PrefetchN] == true))
             return false;
       }*/
 
+      if (PrefetchTagMatch)
+         return FirstTagMatch(PrefetchTagMatch, PrefetchTagAddress.data(), PREF_N * PREF_M, ReferenceTagAddress) == PREF_N * PREF_M;
+
       for (uint32_t PrefetchN = 0; PrefetchN < PREF_N; PrefetchN++)
       {
          for (uint32_t PrefetchM = 0; PrefetchM < PREF_M; PrefetchM++)
          {
-            if (PrefetchTagAddress[PrefetchN][PrefetchM] == ReferenceTagAddress)
+            if (PrefetchStream(PrefetchN)[PrefetchM] == ReferenceTagAddress)
                return false;
          }
       }
       return true;
    }
 
-   void UpdatePrefetchContents(uint32_t TagData, bool WriteFlag)
+   // Prefetched blocks are read from the next level down, or are memory traffic at the last level
+   template <typename LowerChain = MemoryLevel>
+   void FetchPrefetchBlocks(const CacheAddress *Blocks, uint32_t Count)
+   {
+      if constexpr (LowerChain::IsMemory)
+      {
+         Statistics.MemoryTraffic += Count;
+         for (uint32_t BlockCounter = 0; LowerChain::TimedFlag && (BlockCounter < Count); BlockCounter++)
+            LogMemoryRequest<LowerChain>(Blocks[BlockCounter], MemoryPrefetchRead);
+      }
+      else
+      {
+         for (uint32_t BlockCounter = 0; BlockCounter < Count; BlockCounter++)
+            FetchBlock<LowerChain>(Blocks[BlockCounter], true);
+      }
+   }
+
+   template <typename LowerChain = MemoryLevel>
+   void UpdatePrefetchContents(const array<CacheAddress, 5> &TagIndividualDataBits, bool WriteFlag)
    {
+      ProfileRegion(ProfileUpdatePrefetchContents);
       if ((PREF_N == 0) || (PREF_M == 0))
          return;
 
-      array<uint32_t, 4> TagIndividualDataBits = GetTagParameters(TagData);
-      uint32_t CurrentBlockAddress = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB], 0);
-      //uint32_t NextBlockAddress = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB] + 1, 0);
-
-      vector<uint32_t> PrefetchLruOrderSearch;
-      PrefetchLruOrderSearch.resize(PREF_N);
-      for (uint32_t i = 0; i < PREF_N; i++)
-      {
-         for (uint32_t ii = 0; ii < PREF_N; ii++)
-         {
-            if (PrefetchLruBit[ii] == i)
-            {
-               PrefetchLruOrderSearch[i] = ii;
-               break;
-            }
-         }
-      }
+      CacheAddress CurrentBlockAddress = TagIndividualDataBits[BlockB];
+      //uint32_t NextBlockAddress = BlockAddressOffset(CurrentBlockAddress, 1);
 
-      for (uint32_t PrefetchNSearch = 0; PrefetchNSearch < PREF_N; PrefetchNSearch++)
+      // Streams are visited MRU first, so invalid streams (always at the LRU end) are only reached after every valid one
+      for (uint32_t NSearchLru = PrefetchLruEnds[LruHead]; NSearchLru != LruNone; NSearchLru = PrefetchLruNext[NSearchLru])
       {
-         uint32_t NSearchLru = PrefetchLruOrderSearch[PrefetchNSearch];
-
          // Prefetch Miss and invalid Prefetch Streams available
          if (!(PrefetchValidBit[NSearchLru]))
          {
             PrefetchValidBit[NSearchLru] = true;
             for (uint32_t PrefetchMSearch = 0; PrefetchMSearch < PREF_M; PrefetchMSearch++)
-               PrefetchTagAddress[NSearchLru][PrefetchMSearch] = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB] + 1 + PrefetchMSearch);
+               PrefetchStream(NSearchLru)[PrefetchMSearch] = BlockAddressOffset(CurrentBlockAddress, 1 + PrefetchMSearch);
 
-            UpdatePrefetchLRU(TagData, PrefetchLruBit[NSearchLru]);
-            PrefetchesCount += PREF_M;
-            MemoryTraffic += PREF_M;
+            UpdatePrefetchLRU(TagIndividualDataBits, NSearchLru);
+            Statistics.PrefetchesCount += PREF_M;
+            FetchPrefetchBlocks<LowerChain>(PrefetchStream(NSearchLru), PREF_M);
             return;
          }
 
          // Prefetch Stream Available. update Existing Stream
-         for (uint32_t PrefetchMSearch = 0; PrefetchMSearch < PREF_M; PrefetchMSearch++)
+         uint32_t PrefetchMSearch = 0;
+         if (PrefetchTagMatch)
+            PrefetchMSearch = FirstTagMatch(PrefetchTagMatch, PrefetchStream(NSearchLru), PREF_M, CurrentBlockAddress);
+         else
          {
-            // if ((PrefetchValidBit[NSearchLru]) && (((PrefetchTagAddress[NSearchLru][PrefetchMSearch]) == CurrentBlockAddress) || ((PrefetchTagAddress[NSearchLru][PrefetchMSearch]) == NextBlockAddress)))
-            if ((PrefetchValidBit[NSearchLru]) && (((PrefetchTagAddress[NSearchLru][PrefetchMSearch]) == CurrentBlockAddress)))
-            {
-               for (uint32_t PrefetchMSearch2 = 0; PrefetchMSearch2 < PREF_M; PrefetchMSearch2++)
-                  PrefetchTagAddress[NSearchLru][PrefetchMSearch2] = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB] + 1 + 0 + PrefetchMSearch2);
-
-               UpdatePrefetchLRU(TagData, PrefetchLruBit[NSearchLru]);
-               PrefetchesCount += (PrefetchMSearch + 1);
-               MemoryTraffic += (PrefetchMSearch + 1);
-               return;
-            }
+            while ((PrefetchMSearch < PREF_M) && (PrefetchStream(NSearchLru)[PrefetchMSearch] != CurrentBlockAddress))
+               PrefetchMSearch++;
          }
-      }
 
-      // Prefetch Stream Miss. Adding new stream to LRU Stream
-      for (uint32_t PrefetchNSearch = 0; PrefetchNSearch < PREF_N; PrefetchNSearch++)
-      {
-         uint32_t NSearchLru = PrefetchLruOrderSearch[PrefetchNSearch];
-         if (PrefetchLruBit[NSearchLru] == PREF_N - 1)
+         if (PrefetchMSearch < PREF_M)
          {
-            for (uint32_t PrefetchMSearch = 0; PrefetchMSearch < PREF_M; PrefetchMSearch++)
-               PrefetchTagAddress[NSearchLru][PrefetchMSearch] = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB] + 1 + PrefetchMSearch);
-            UpdatePrefetchLRU(TagData, PrefetchLruBit[NSearchLru]);
-            PrefetchesCount += PREF_M;
-            MemoryTraffic += PREF_M;
+            for (uint32_t PrefetchMSearch2 = 0; PrefetchMSearch2 < PREF_M; PrefetchMSearch2++)
+               PrefetchStream(NSearchLru)[PrefetchMSearch2] = BlockAddressOffset(CurrentBlockAddress, 1 + 0 + PrefetchMSearch2);
+
+            UpdatePrefetchLRU(TagIndividualDataBits, NSearchLru);
+            Statistics.PrefetchesCount += (PrefetchMSearch + 1);
+            Statistics.UselessPrefetchCount += PrefetchMSearch; // the blocks ahead of the hit were skipped
+            // Only the blocks shifted in at the tail of the stream are new
+            FetchPrefetchBlocks<LowerChain>(PrefetchStream(NSearchLru) + PREF_M - (PrefetchMSearch + 1), PrefetchMSearch + 1);
             return;
          }
       }
+
+      // Prefetch Stream Miss. Adding new stream to LRU Stream
+      uint32_t NSearchLru = PrefetchLruEnds[LruTail];
+      for (uint32_t PrefetchMSearch = 0; PrefetchMSearch < PREF_M; PrefetchMSearch++)
+         PrefetchStream(NSearchLru)[PrefetchMSearch] = BlockAddressOffset(CurrentBlockAddress, 1 + PrefetchMSearch);
+      UpdatePrefetchLRU(TagIndividualDataBits, NSearchLru);
+      Statistics.PrefetchesCount += PREF_M;
+      Statistics.UselessPrefetchCount += PREF_M; // the replaced stream's blocks were never read
+      FetchPrefetchBlocks<LowerChain>(PrefetchStream(NSearchLru), PREF_M);
    }
 
-   bool UpdatePrefetchLRU(uint32_t TagData, uint32_t PrefetchLruReference = 0xffffffff)
+   // Makes stream PrefetchLruReference the MRU stream; by default the stream whose head is the next block
+   bool UpdatePrefetchLRU(const array<CacheAddress, 5> &TagIndividualDataBits, uint32_t PrefetchLruReference = 0xffffffff)
    {
       if (PREF_N == 0)
          return false;
 
-      array<uint32_t, 4> TagIndividualDataBits = GetTagParameters(TagData);
-      //uint32_t CurrentBlockAddress = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB]);
-      uint32_t NextBlockAddress = TagAddressCalculation(TagIndividualDataBits[TagB], TagIndividualDataBits[IndexB] + 1);
-
       if (PrefetchLruReference == 0xffffffff)
       {
+         //uint32_t CurrentBlockAddress = TagIndividualDataBits[BlockB];
+         CacheAddress NextBlockAddress = BlockAddressOffset(TagIndividualDataBits[BlockB], 1);
          PrefetchLruReference = PREF_N - 1;
          for (uint32_t PrefetchNSearch = 0; PrefetchNSearch < PREF_N; PrefetchNSearch++)
          {
-            if ((PrefetchValidBit[PrefetchNSearch]) && (((PrefetchTagAddress[PrefetchNSearch][0]) == NextBlockAddress)))
+            if ((PrefetchValidBit[PrefetchNSearch]) && (((PrefetchStream(PrefetchNSearch)[0]) == NextBlockAddress)))
             {
                PrefetchLruReference = PrefetchNSearch;
                break;
@@ -493,13 +1024,7 @@ public:
          }
       }
 
-      for (uint32_t PrefetchSearchN = 0; PrefetchSearchN < PREF_N; PrefetchSearchN++)
-      {
-         if (PrefetchLruBit[PrefetchSearchN] < PrefetchLruReference)
-            PrefetchLruBit[PrefetchSearchN]++;
-         else if (PrefetchLruBit[PrefetchSearchN] == PrefetchLruReference)
-            PrefetchLruBit[PrefetchSearchN] = 0;
-      }
+      LruListTouch(PrefetchLruPrev.data(), PrefetchLruNext.data(), PrefetchLruEnds, PrefetchLruReference);
       return true;
    }
 
@@ -515,30 +1040,18 @@ public:
            << endl
            << "===== Stream Buffer(s) contents =====" << endl;
 
-      vector<uint32_t> PrefetchLruOrderSearch;
-      PrefetchLruOrderSearch.resize(PREF_N);
-      for (uint32_t i = 0; i < PREF_N; i++)
+      for (uint32_t LruOderSearch = PrefetchLruEnds[LruHead]; LruOderSearch != LruNone; LruOderSearch = PrefetchLruNext[LruOderSearch])
       {
-         for (uint32_t ii = 0; ii < PREF_N; ii++)
-         {
-            if (PrefetchLruBit[ii] == i)
-            {
-               PrefetchLruOrderSearch[i] = ii;
-               break;
-            }
-         }
-      }
-      for (uint32_t PrefetchNSearch = 0; PrefetchNSearch < PREF_N; PrefetchNSearch++)
-      {
-         uint32_t LruOderSearch = PrefetchLruOrderSearch[PrefetchNSearch];
          if (PrefetchValidBit[LruOderSearch])
          {
             for (uint32_t PrefetchMSearch = 0; PrefetchMSearch < PREF_M; PrefetchMSearch++)
             {
-               cout << " " << IntegerTostring(PrefetchTagAddress[LruOderSearch][PrefetchMSearch], !true) << " ";
+               cout << " " << IntegerTostring(PrefetchStream(LruOderSearch)[PrefetchMSearch], !true) << " ";
             }
             cout << endl;
          }
       }
    }
 };
+
+#include "replacement.h"
@@ -0,0 +1,137 @@
+#include "trace_generator.h"
+#include <chrono>
+#include <sys/wait.h>
+using namespace std;
+
+// Throughput benchmark of the sim binary: every configuration runs every synthetic workload
+// --runs times, and each case reports the median, mean, variance and coefficient of variation
+// of the accesses per second (in millions, the whole sim process timed, trace loading included;
+// the cache contents are left out of the report).
+// The output is CSV with a fixed header and column order, for regression tracking.
+// usage: sim_bench [--sim=PATH] [--records=N] [--runs=N] [--dir=DIR]
+// Traces are generated in a temporary directory under --dir (default /tmp) and removed afterwards.
+
+struct BenchConfiguration
+{
+   const char *Name;
+   const char *Arguments; // sim's positional arguments before the trace file
+};
+
+struct BenchWorkload
+{
+   const char *Name;
+   uint32_t Pattern;
+   uint32_t Footprint;
+   double WriteRatio;
+};
+
+static const BenchConfiguration BenchConfigurations[] = {
+    {"l1_direct_mapped", "64 32768 1 0 0 0 0"},
+    {"l1_8way_l2_16way", "64 32768 8 1048576 16 0 0"},
+    {"l1_8way_l2_16way_stream", "64 32768 8 1048576 16 4 8"}};
+
+static const BenchWorkload BenchWorkloads[] = {
+    {"sequential", PatternSequential, 16 << 20, 0.3},
+    {"strided", PatternStrided, 16 << 20, 0.3},
+    {"random", PatternRandom, 16 << 20, 0.3},
+    {"zipf", PatternZipf, 16 << 20, 0.3},
+    {"zipf_read_mostly", PatternZipf, 4 << 20, 0.05}};
+
+int main(int ArgumentCount, char *ArgumentVariables[])
+{
+   string SimPath = "./sim";
+   string Directory = "/tmp";
+   uint64_t RecordCount = 4000000;
+   uint32_t RunCount = 5;
+
+   for (int ArgumentCounter = 1; ArgumentCounter < ArgumentCount; ArgumentCounter++)
+   {
+      const char *Argument = ArgumentVariables[ArgumentCounter];
+      if (strncmp(Argument, "--sim=", 6) == 0)
+         SimPath = Argument + 6;
+      else if (strncmp(Argument, "--records=", 10) == 0)
+         RecordCount = strtoull(Argument + 10, NULL, 0);
+      else if (strncmp(Argument, "--runs=", 7) == 0)
+         RunCount = (uint32_t)atoi(Argument + 7);
+      else if (strncmp(Argument, "--dir=", 6) == 0)
+         Directory = Argument + 6;
+      else
+      {
+         cout << "usage: sim_bench [--sim=PATH] [--records=N] [--runs=N] [--dir=DIR]" << endl;
+         exit(EXIT_FAILURE);
+      }
+   }
+   if ((RecordCount == 0) || (RunCount == 0))
+   {
+      cout << "Error: --records and --runs need to be positive" << '\n';
+      exit(EXIT_FAILURE);
+   }
+
+   string TemplateName = Directory + "/sim_bench.XXXXXX";
+   vector<char> TraceDirectory(TemplateName.begin(), TemplateName.end());
+   TraceDirectory.push_back('\0');
+   if (mkdtemp(TraceDirectory.data()) == NULL)
+   {
+      cout << "Error: Cannot create a trace directory in " << Directory << '\n';
+      exit(EXIT_FAILURE);
+   }
+
+   vector<string> TraceFileNames;
+   for (const BenchWorkload &Workload : BenchWorkloads)
+   {
+      TraceGeneratorConfiguration Configuration;
+      Configuration.Pattern = Workload.Pattern;
+      Configuration.Footprint = Workload.Footprint;
+      Configuration.WriteRatio = Workload.WriteRatio;
+      TraceFileNames.push_back(string(TraceDirectory.data()) + "/" + Workload.Name + ".bin");
+      TraceGenerator Generator(Configuration);
+      if (!Generator.WriteTrace(TraceFileNames.back().c_str(), RecordCount))
+      {
+         cout << "Error: Writing " << TraceFileNames.back() << " failed" << '\n';
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   cout << "configuration,workload,records,runs,median_maps,mean_maps,variance_maps2,cv_percent" << endl;
+   bool Success = true;
+   for (const BenchConfiguration &Configuration : BenchConfigurations)
+   {
+      for (uint32_t Workload = 0; Success && (Workload < sizeof(BenchWorkloads) / sizeof(BenchWorkloads[0])); Workload++)
+      {
+         string Command = SimPath + " --no-contents " + Configuration.Arguments + " " + TraceFileNames[Workload] + " > /dev/null";
+         vector<double> Rates;
+         for (uint32_t Run = 0; Run < RunCount; Run++)
+         {
+            chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+            int Status = system(Command.c_str());
+            double Seconds = chrono::duration<double>(chrono::steady_clock::now() - Start).count();
+            if ((Status == -1) || !WIFEXITED(Status) || (WEXITSTATUS(Status) != 0))
+            {
+               cout << "Error: " << Command << " failed" << '\n';
+               Success = false;
+               break;
+            }
+            Rates.push_back(double(RecordCount) / Seconds / 1e6);
+         }
+         if (!Success)
+            break;
+
+         sort(Rates.begin(), Rates.end());
+         double Median = (RunCount % 2) ? Rates[RunCount / 2] : (Rates[RunCount / 2 - 1] + Rates[RunCount / 2]) / 2;
+         double Mean = 0;
+         for (double Rate : Rates)
+            Mean += Rate / RunCount;
+         double Variance = 0;
+         for (double Rate : Rates)
+            Variance += (Rate - Mean) * (Rate - Mean) / max(RunCount - 1, 1u);
+         printf("%s,%s,%llu,%u,%.3f,%.3f,%.4f,%.2f\n", Configuration.Name, BenchWorkloads[Workload].Name, (unsigned long long)RecordCount, RunCount,
+                Median, Mean, Variance, 100 * sqrt(Variance) / Mean);
+         fflush(stdout);
+      }
+   }
+
+   for (const string &TraceFileName : TraceFileNames)
+      unlink(TraceFileName.c_str());
+   rmdir(TraceDirectory.data());
+   return Success ? 0 : EXIT_FAILURE;
+}
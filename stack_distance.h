@@ -0,0 +1,160 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include "trace_reader.h"
+#include <math.h>
+#include <unordered_map>
+
+// LRU stack distance (Mattson) analysis for a fixed BLOCKSIZE and number of sets. The distance
+// of an access is the number of distinct blocks of the same set referenced since the previous
+// access to its block, so an ASSOC-way LRU cache hits exactly when the distance is below ASSOC
+// and one pass yields the miss count of every ASSOC.
+//
+// Each set numbers its own accesses. A Fenwick tree over those access times marks the last
+// access of every block in the set, so the distance is the count of marks after the block's
+// previous access, O(log n) per access. When a set runs out of time slots its live marks are
+// renumbered in order, into a tree twice the size if more than half of it is live.
+
+#define StackDistanceInitialSlots 64
+
+class StackDistanceAnalyzer
+{
+public:
+   uint32_t BlockSize;
+   uint32_t SetCount;
+   uint64_t ReadCount = 0;
+   uint64_t WriteCount = 0;
+   uint64_t ColdReadCount = 0;
+   uint64_t ColdWriteCount = 0;
+   vector<uint64_t> ReadDistanceCount; // [distance] for accesses that were seen before
+   vector<uint64_t> WriteDistanceCount;
+
+   StackDistanceAnalyzer(uint32_t InputBlockSize, uint32_t InputSetCount)
+   {
+      BlockSize = InputBlockSize;
+      SetCount = InputSetCount;
+      BlockOffsetBitCount = log2(InputBlockSize);
+      Sets.resize(InputSetCount);
+      for (StackDistanceSet &Set : Sets)
+      {
+         Set.Tree.assign(StackDistanceInitialSlots + 1, 0);
+         Set.BlockAtTime.assign(StackDistanceInitialSlots, 0);
+      }
+   }
+
+   void Access(CacheAddress Address, bool WriteFlag)
+   {
+      CacheAddress BlockAddress = Address >> BlockOffsetBitCount;
+      StackDistanceSet &Set = Sets[BlockAddress & (SetCount - 1)];
+      if (Set.NextTime == Set.BlockAtTime.size())
+         Compact(Set);
+
+      uint32_t Time = Set.NextTime++;
+      pair<unordered_map<CacheAddress, uint32_t>::iterator, bool> Entry = LastAccessTime.emplace(BlockAddress, Time);
+      (WriteFlag ? WriteCount : ReadCount) += 1;
+      if (Entry.second)
+      {
+         (WriteFlag ? ColdWriteCount : ColdReadCount) += 1;
+         Set.LiveBlocks++;
+      }
+      else
+      {
+         uint32_t PreviousTime = Entry.first->second;
+         uint32_t Distance = Set.LiveBlocks - Prefix(Set, PreviousTime);
+         vector<uint64_t> &DistanceCount = WriteFlag ? WriteDistanceCount : ReadDistanceCount;
+         if (Distance >= DistanceCount.size())
+            DistanceCount.resize(Distance + 1, 0);
+         DistanceCount[Distance] += 1;
+         Add(Set, PreviousTime, -1);
+         Entry.first->second = Time;
+      }
+      Add(Set, Time, 1);
+      Set.BlockAtTime[Time] = BlockAddress;
+   }
+
+   // Misses of an ASSOC-way LRU cache with SetCount sets
+   uint64_t ReadMisses(uint32_t Assoc) const
+   {
+      return ColdReadCount + DistanceTail(ReadDistanceCount, Assoc);
+   }
+
+   uint64_t WriteMisses(uint32_t Assoc) const
+   {
+      return ColdWriteCount + DistanceTail(WriteDistanceCount, Assoc);
+   }
+
+   // Smallest ASSOC with only cold misses left; every larger ASSOC has the same miss count
+   uint32_t MaxUsefulAssoc() const
+   {
+      return (uint32_t)max(ReadDistanceCount.size(), WriteDistanceCount.size());
+   }
+
+private:
+   struct StackDistanceSet
+   {
+      vector<int32_t> Tree;          // Fenwick tree, 1-based, over this set's access times
+      vector<CacheAddress> BlockAtTime;  // block accessed at each time, valid where marked
+      uint32_t NextTime = 0;
+      uint32_t LiveBlocks = 0;
+   };
+
+   uint32_t BlockOffsetBitCount;
+   vector<StackDistanceSet> Sets;
+   unordered_map<CacheAddress, uint32_t> LastAccessTime;
+
+   static uint64_t DistanceTail(const vector<uint64_t> &DistanceCount, uint32_t Assoc)
+   {
+      uint64_t Count = 0;
+      for (size_t Distance = Assoc; Distance < DistanceCount.size(); Distance++)
+         Count += DistanceCount[Distance];
+      return Count;
+   }
+
+   // Marks at times 0..Time inclusive
+   static uint32_t Prefix(const StackDistanceSet &Set, uint32_t Time)
+   {
+      int32_t Count = 0;
+      for (size_t Node = (size_t)Time + 1; Node > 0; Node -= Node & (0 - Node))
+         Count += Set.Tree[Node];
+      return (uint32_t)Count;
+   }
+
+   static void Add(StackDistanceSet &Set, uint32_t Time, int32_t Value)
+   {
+      for (size_t Node = (size_t)Time + 1; Node < Set.Tree.size(); Node += Node & (0 - Node))
+         Set.Tree[Node] += Value;
+   }
+
+   void Compact(StackDistanceSet &Set)
+   {
+      // Live marks are exactly the times still recorded in LastAccessTime for their block
+      vector<CacheAddress> LiveBlocks;
+      LiveBlocks.reserve(Set.LiveBlocks);
+      for (uint32_t Time = 0; Time < Set.NextTime; Time++)
+      {
+         if (LastAccessTime[Set.BlockAtTime[Time]] == Time)
+            LiveBlocks.push_back(Set.BlockAtTime[Time]);
+      }
+
+      size_t Slots = Set.BlockAtTime.size();
+      if (2 * LiveBlocks.size() > Slots)
+         Slots *= 2;
+      Set.BlockAtTime.assign(Slots, 0);
+      Set.Tree.assign(Slots + 1, 0);
+      for (uint32_t Time = 0; Time < LiveBlocks.size(); Time++)
+      {
+         Set.BlockAtTime[Time] = LiveBlocks[Time];
+         LastAccessTime[LiveBlocks[Time]] = Time;
+         Set.Tree[Time + 1] = 1;
+      }
+      for (size_t Node = 1; Node <= Slots; Node++)
+      {
+         size_t Parent = Node + (Node & (0 - Node));
+         if (Parent <= Slots)
+            Set.Tree[Parent] += Set.Tree[Node];
+      }
+      Set.NextTime = (uint32_t)LiveBlocks.size();
+   }
+};
+
+#endif
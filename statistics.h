@@ -0,0 +1,77 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Event counters of one CacheModule. They are 64-bit, so they do not wrap on traces of billions of
+// accesses. The counters a demand access can touch come first and fill one host cache line. The
+// rest follow on the next line. A snapshot is a plain copy:
+//   - --interval reports Since() the previous snapshot
+//   - set sampling scales the counters up
+//   - --cores adds the private caches together
+// PrefetchHitCount and UselessPrefetchCount cover the stream buffers. The prefetcher engines
+// keep their own counts in prefetcher.h.
+
+struct alignas(HostCacheLineSize) CacheStatistics
+{
+   uint64_t ReadCount = 0;        // demand reads (the top level: every read)
+   uint64_t ReadMissCount = 0;
+   uint64_t WriteCount = 0;
+   uint64_t WriteMissCount = 0;
+   uint64_t WriteBackCount = 0;   // dirty blocks written back out of this level
+   uint64_t PrefetchesCount = 0;  // blocks the stream buffers asked for
+   uint64_t MemoryTraffic = 0;    // blocks this level read from or wrote to memory
+   uint64_t PrefetchHitCount = 0; // demand accesses the cache missed and the stream buffers supplied
+
+   uint64_t ReadPrefetchCount = 0; // prefetch reads from the level above
+   uint64_t ReadMissPrefetchCount = 0;
+   uint64_t UselessPrefetchCount = 0; // stream buffer blocks dropped without being read: skipped over, or lost to a new stream
+   uint64_t MemoryWriteBackCount = 0; // the write-backs that went to memory rather than to the next level
+
+   template <typename Visitor>
+   static void ForEachCounter(Visitor Visit)
+   {
+      for (uint64_t CacheStatistics::*Counter : {&CacheStatistics::ReadCount, &CacheStatistics::ReadMissCount, &CacheStatistics::WriteCount, &CacheStatistics::WriteMissCount,
+                                                  &CacheStatistics::WriteBackCount, &CacheStatistics::PrefetchesCount, &CacheStatistics::MemoryTraffic, &CacheStatistics::PrefetchHitCount,
+                                                  &CacheStatistics::ReadPrefetchCount, &CacheStatistics::ReadMissPrefetchCount, &CacheStatistics::UselessPrefetchCount, &CacheStatistics::MemoryWriteBackCount})
+         Visit(Counter);
+   }
+
+   void Add(const CacheStatistics &Other)
+   {
+      ForEachCounter([this, &Other](uint64_t CacheStatistics::*Counter)
+                     { this->*Counter += Other.*Counter; });
+   }
+
+   // The events counted after the Previous snapshot
+   CacheStatistics Since(const CacheStatistics &Previous) const
+   {
+      CacheStatistics Difference = *this;
+      ForEachCounter([&Difference, &Previous](uint64_t CacheStatistics::*Counter)
+                     { Difference.*Counter -= Previous.*Counter; });
+      return Difference;
+   }
+
+   void Scale(double Factor)
+   {
+      ForEachCounter([this, Factor](uint64_t CacheStatistics::*Counter)
+                     { this->*Counter = (uint64_t)llround(this->*Counter * Factor); });
+   }
+
+   // The top level counts all its accesses as demand accesses, the lower levels only reads
+   uint64_t DemandAccesses(bool TopFlag) const
+   {
+      return TopFlag ? ReadCount + WriteCount : ReadCount;
+   }
+
+   uint64_t DemandMisses(bool TopFlag) const
+   {
+      return TopFlag ? ReadMissCount + WriteMissCount : ReadMissCount;
+   }
+};
+
+static_assert(offsetof(CacheStatistics, ReadPrefetchCount) == HostCacheLineSize, "the per-access counters fill the first host cache line");
+
+#endif
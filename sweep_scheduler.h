@@ -0,0 +1,168 @@
+#ifndef SWEEP_SCHEDULER_H
+#define SWEEP_SCHEDULER_H
+
+#include "trace_reader.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Parallel sweep execution. The calling thread decodes the trace into a ring of record batches
+// that every simulation reads; a slot counts the simulations that still have to read it and is
+// refilled once that count drops to zero. The simulations themselves are the unit of work: a
+// worker takes one from its own deque, or steals one from another worker, runs it over every
+// batch decoded so far and queues it again. Each simulation sees the batches strictly in trace
+// order, so its results do not depend on how the work was scheduled.
+
+#define SweepRingBatches 64
+
+class SweepScheduler
+{
+public:
+   // Simulate(SimulationIndex, Records, RecordCount) must only touch state of that simulation
+   template <typename SimulateFunction>
+   static void Run(TraceReader &Trace, size_t SimulationCount, uint32_t ThreadCount, size_t BatchSize, SimulateFunction Simulate)
+   {
+      Run(Trace, SimulationCount, ThreadCount, BatchSize, [](size_t, const TraceRecord *, size_t) {},
+          [&Simulate](size_t Simulation, size_t, const TraceRecord *Records, size_t RecordCount)
+          { Simulate(Simulation, Records, RecordCount); });
+   }
+
+   // As above, with Prepare(Slot, Records, RecordCount) called in the decoding thread on each
+   // batch before any simulation reads it, to derive per-slot data the simulations share, and
+   // Simulate(SimulationIndex, Slot, Records, RecordCount) told which of the SweepRingBatches
+   // slots the batch is in
+   template <typename PrepareFunction, typename SimulateFunction>
+   static void Run(TraceReader &Trace, size_t SimulationCount, uint32_t ThreadCount, size_t BatchSize, PrepareFunction Prepare, SimulateFunction Simulate)
+   {
+      SweepScheduler Scheduler(SimulationCount, min((size_t)ThreadCount, SimulationCount), BatchSize);
+      vector<thread> Workers;
+      for (uint32_t WorkerIndex = 0; WorkerIndex < Scheduler.WorkerCount; WorkerIndex++)
+         Workers.emplace_back([&Scheduler, &Simulate, WorkerIndex]()
+                              { Scheduler.Work(WorkerIndex, Simulate); });
+      Scheduler.Decode(Trace, Prepare);
+      for (thread &Worker : Workers)
+         Worker.join();
+   }
+
+private:
+   struct RingSlot
+   {
+      vector<TraceRecord> Records;
+      size_t RecordCount = 0;
+      atomic<size_t> PendingSimulations{0};
+   };
+
+   struct WorkerQueue
+   {
+      mutex Lock;
+      deque<size_t> Simulations;
+   };
+
+   size_t SimulationCount;
+   uint32_t WorkerCount;
+   size_t BatchSize;
+   unique_ptr<RingSlot[]> Slots;
+   unique_ptr<WorkerQueue[]> Queues;
+   vector<uint64_t> NextBatch; // per simulation, only touched by the worker holding it
+   atomic<uint64_t> DecodedBatches{0};
+   atomic<bool> DecodeDone{false};
+   atomic<size_t> FinishedSimulations{0};
+
+   SweepScheduler(size_t InputSimulationCount, size_t InputWorkerCount, size_t InputBatchSize)
+       : SimulationCount(InputSimulationCount), WorkerCount((uint32_t)InputWorkerCount), BatchSize(InputBatchSize),
+         Slots(new RingSlot[SweepRingBatches]), Queues(new WorkerQueue[InputWorkerCount]), NextBatch(InputSimulationCount, 0)
+   {
+      for (uint32_t SlotIndex = 0; SlotIndex < SweepRingBatches; SlotIndex++)
+         Slots[SlotIndex].Records.resize(BatchSize);
+      for (size_t Simulation = 0; Simulation < SimulationCount; Simulation++)
+         Queues[Simulation % WorkerCount].Simulations.push_back(Simulation);
+   }
+
+   template <typename PrepareFunction>
+   void Decode(TraceReader &Trace, PrepareFunction &Prepare)
+   {
+      for (uint64_t Batch = 0; SimulationCount > 0; Batch++)
+      {
+         RingSlot &Slot = Slots[Batch % SweepRingBatches];
+         while (Slot.PendingSimulations.load(memory_order_acquire) != 0)
+            this_thread::yield();
+         Slot.RecordCount = Trace.ReadRecords(Slot.Records.data(), BatchSize);
+         if (Slot.RecordCount == 0)
+            break;
+         Prepare(Batch % SweepRingBatches, (const TraceRecord *)Slot.Records.data(), Slot.RecordCount);
+         Slot.PendingSimulations.store(SimulationCount, memory_order_relaxed);
+         DecodedBatches.store(Batch + 1, memory_order_release);
+      }
+      DecodeDone.store(true, memory_order_release);
+   }
+
+   template <typename SimulateFunction>
+   void Work(uint32_t WorkerIndex, SimulateFunction &Simulate)
+   {
+      size_t Simulation;
+      while (FinishedSimulations.load(memory_order_acquire) < SimulationCount)
+      {
+         if (!TakeSimulation(WorkerIndex, Simulation))
+         {
+            this_thread::yield();
+            continue;
+         }
+
+         // DecodeDone is read first: once it is set DecodedBatches is final
+         bool Done = DecodeDone.load(memory_order_acquire);
+         uint64_t AvailableBatches = DecodedBatches.load(memory_order_acquire);
+         uint64_t &Batch = NextBatch[Simulation];
+         if ((Batch == AvailableBatches) && Done)
+         {
+            FinishedSimulations.fetch_add(1, memory_order_release);
+            continue;
+         }
+
+         bool Waiting = (Batch == AvailableBatches);
+         for (; Batch < AvailableBatches; Batch++)
+         {
+            RingSlot &Slot = Slots[Batch % SweepRingBatches];
+            Simulate(Simulation, (size_t)(Batch % SweepRingBatches), (const TraceRecord *)Slot.Records.data(), Slot.RecordCount);
+            Slot.PendingSimulations.fetch_sub(1, memory_order_release);
+         }
+         PutSimulation(WorkerIndex, Simulation);
+         if (Waiting)
+            this_thread::yield();
+      }
+   }
+
+   // Own queue first (oldest first, so a worker round-robins its simulations), then steal the
+   // most recently queued simulation of the next busy worker
+   bool TakeSimulation(uint32_t WorkerIndex, size_t &Simulation)
+   {
+      for (uint32_t Offset = 0; Offset < WorkerCount; Offset++)
+      {
+         WorkerQueue &Queue = Queues[(WorkerIndex + Offset) % WorkerCount];
+         lock_guard<mutex> Guard(Queue.Lock);
+         if (Queue.Simulations.empty())
+            continue;
+         if (Offset == 0)
+         {
+            Simulation = Queue.Simulations.front();
+            Queue.Simulations.pop_front();
+         }
+         else
+         {
+            Simulation = Queue.Simulations.back();
+            Queue.Simulations.pop_back();
+         }
+         return true;
+      }
+      return false;
+   }
+
+   void PutSimulation(uint32_t WorkerIndex, size_t Simulation)
+   {
+      lock_guard<mutex> Guard(Queues[WorkerIndex].Lock);
+      Queues[WorkerIndex].Simulations.push_back(Simulation);
+   }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef TAG_MATCH_H
+#define TAG_MATCH_H
+
+#include <stdint.h>
+#include "address_width.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TagMatchX86 1
+#endif
+
+// Tag-match kernels: bit i of the result is set when Tags[i] == Tag, for Count <= 64.
+// The vector kernels are compiled per target and picked once at run time by SelectTagMatchKernel.
+// Tags are CacheAddress wide: 32-bit lanes by default, 64-bit lanes under SIM_ADDRESS_64.
+
+typedef uint64_t (*TagMatchKernel)(const CacheAddress *Tags, uint32_t Count, CacheAddress Tag);
+
+#define TagMatchKernelWidth 64
+#define TagMatchVectorThreshold 4
+
+static inline uint64_t TagMatchScalar(const CacheAddress *Tags, uint32_t Count, CacheAddress Tag)
+{
+   uint64_t MatchMask = 0;
+   for (uint32_t TagSearch = 0; TagSearch < Count; TagSearch++)
+      MatchMask |= (uint64_t)(Tags[TagSearch] == Tag) << TagSearch;
+   return MatchMask;
+}
+
+#if defined(TagMatchX86) && !defined(SIM_ADDRESS_64)
+__attribute__((target("sse2"))) static inline uint64_t TagMatchSSE2(const uint32_t *Tags, uint32_t Count, uint32_t Tag)
+{
+   uint64_t MatchMask = 0;
+   uint32_t TagSearch = 0;
+   __m128i TagVector = _mm_set1_epi32((int)Tag);
+   for (; TagSearch + 4 <= Count; TagSearch += 4)
+   {
+      __m128i Compare = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(Tags + TagSearch)), TagVector);
+      MatchMask |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(Compare)) << TagSearch;
+   }
+   for (; TagSearch < Count; TagSearch++)
+      MatchMask |= (uint64_t)(Tags[TagSearch] == Tag) << TagSearch;
+   return MatchMask;
+}
+
+__attribute__((target("avx2"))) static inline uint64_t TagMatchAVX2(const uint32_t *Tags, uint32_t Count, uint32_t Tag)
+{
+   uint64_t MatchMask = 0;
+   uint32_t TagSearch = 0;
+   __m256i TagVector = _mm256_set1_epi32((int)Tag);
+   for (; TagSearch + 8 <= Count; TagSearch += 8)
+   {
+      __m256i Compare = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(Tags + TagSearch)), TagVector);
+      MatchMask |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(Compare)) << TagSearch;
+   }
+   if (TagSearch + 4 <= Count)
+   {
+      __m128i Compare = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(Tags + TagSearch)), _mm256_castsi256_si128(TagVector));
+      MatchMask |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(Compare)) << TagSearch;
+      TagSearch += 4;
+   }
+   for (; TagSearch < Count; TagSearch++)
+      MatchMask |= (uint64_t)(Tags[TagSearch] == Tag) << TagSearch;
+   return MatchMask;
+}
+#endif
+
+#if defined(TagMatchX86) && defined(SIM_ADDRESS_64)
+__attribute__((target("sse4.1"))) static inline uint64_t TagMatchSSE41(const uint64_t *Tags, uint32_t Count, uint64_t Tag)
+{
+   uint64_t MatchMask = 0;
+   uint32_t TagSearch = 0;
+   __m128i TagVector = _mm_set1_epi64x((long long)Tag);
+   for (; TagSearch + 2 <= Count; TagSearch += 2)
+   {
+      __m128i Compare = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(Tags + TagSearch)), TagVector);
+      MatchMask |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(Compare)) << TagSearch;
+   }
+   for (; TagSearch < Count; TagSearch++)
+      MatchMask |= (uint64_t)(Tags[TagSearch] == Tag) << TagSearch;
+   return MatchMask;
+}
+
+__attribute__((target("avx2"))) static inline uint64_t TagMatchAVX2(const uint64_t *Tags, uint32_t Count, uint64_t Tag)
+{
+   uint64_t MatchMask = 0;
+   uint32_t TagSearch = 0;
+   __m256i TagVector = _mm256_set1_epi64x((long long)Tag);
+   for (; TagSearch + 4 <= Count; TagSearch += 4)
+   {
+      __m256i Compare = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(Tags + TagSearch)), TagVector);
+      MatchMask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(Compare)) << TagSearch;
+   }
+   for (; TagSearch < Count; TagSearch++)
+      MatchMask |= (uint64_t)(Tags[TagSearch] == Tag) << TagSearch;
+   return MatchMask;
+}
+#endif
+
+static inline TagMatchKernel SelectTagMatchKernel()
+{
+#if defined(TagMatchX86) && defined(SIM_ADDRESS_64)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+      return TagMatchAVX2;
+   if (__builtin_cpu_supports("sse4.1"))
+      return TagMatchSSE41;
+#elif defined(TagMatchX86)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+      return TagMatchAVX2;
+   if (__builtin_cpu_supports("sse2"))
+      return TagMatchSSE2;
+#endif
+   return TagMatchScalar;
+}
+
+#endif
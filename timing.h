@@ -0,0 +1,315 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Timing model for --timing. The trace runs on a blocking in-order core: each record issues when
+// the previous access finishes, so the cycle count is the sum of the access times and their mean
+// is the average access time (AAT). An access pays the hit latency of every level it looks up,
+// top down, until one holds the block in the cache or a stream buffer; past the last level it
+// waits for a DRAM read. The cache levels decide hits and misses as in an untimed run, and the
+// model replays the memory requests the last level logs for each record:
+//   - DRAM is open-page: each bank keeps one row open. A read or write to the open row costs tCAS,
+//     to an idle bank tRCD + tCAS and to another row tRP + tRCD + tCAS. The block then crosses the
+//     shared data bus, and reads add the controller latency. Opening a row holds the bank, but
+//     column accesses to an open row pipeline at the bus rate.
+//   - MSHRs bound the reads in flight, demand and stream buffer fills alike. A read that finds
+//     them all busy waits for the first to finish. Prefetches never stall the core, but a demand
+//     hit on a block whose prefetch has not arrived waits for it.
+//   - Write-backs drain to DRAM from a write-back buffer in the background. The core stalls only
+//     when the buffer is full.
+// Levels are told apart by their miss counters, so in the rare case where a write-back below
+// the top level misses and fetches its block, the fetch's miss can be taken for the demand's.
+
+#define TimingIntervalsMax 64 // traffic histogram buckets; the width doubles to stay under this
+#define TimingPrefetchPruneSize 4096
+#define DramRowClosed UINT64_MAX
+
+// Settings of a --timing file, with the defaults used without one (cycles of a ~3 GHz core
+// over DDR4-class memory)
+struct TimingConfiguration
+{
+   vector<pair<string, uint32_t>> Latencies; // hit latency by level name; EstimatedHitLatency otherwise
+   double ClockGhz = 3;
+   uint32_t MshrCount = 16;
+   uint32_t WriteBackBufferEntries = 16;
+   uint32_t DramBanks = 16;
+   uint32_t DramRowSize = 8192;
+   uint32_t DramTcas = 42;
+   uint32_t DramTrcd = 42;
+   uint32_t DramTrp = 42;
+   uint32_t DramBusBytes = 8; // bytes per cycle on the memory bus
+   uint32_t DramController = 30;
+   uint32_t Interval = 100000; // initial width of the traffic histogram buckets
+};
+
+// Hit latency of a level with none configured: access time by capacity from 1 KB to 64 MB, in the
+// spirit of CACTI estimates, plus a cycle each from 8 and from 32 ways for the wider compare
+static inline uint32_t EstimatedHitLatency(uint32_t Size, uint32_t Assoc)
+{
+   static const uint32_t Latencies[] = {1, 1, 1, 2, 2, 3, 4, 5, 7, 9, 11, 14, 17, 21, 26, 31, 37};
+   uint32_t SizeClass = 0;
+   while ((SizeClass + 1 < sizeof(Latencies) / sizeof(Latencies[0])) && ((1024ull << SizeClass) < Size))
+      SizeClass++;
+   return Latencies[SizeClass] + (Assoc >= 8) + (Assoc >= 32);
+}
+
+struct DramBank
+{
+   uint64_t OpenRow = DramRowClosed;
+   uint64_t ReadyCycle = 0;
+};
+
+struct TimingInterval
+{
+   uint64_t Reads = 0;
+   uint64_t Writes = 0;
+};
+
+class TimingModel
+{
+public:
+   TimingConfiguration Configuration;
+   vector<CacheModule *> Levels; // the levels in use, top first
+   vector<uint32_t> HitLatencies;
+   vector<MemoryRequest> Requests; // logged by the last level during the current record
+   uint32_t BlockSize;
+   uint32_t BurstCycles;
+
+   // Results
+   uint64_t Cycle = 0; // the core's clock: the sum of the access times so far
+   uint64_t AccessCount = 0;
+   vector<uint64_t> ServedCounts; // accesses completed at each level, then by memory
+   uint64_t MemoryReadCount = 0;
+   uint64_t MemoryWriteCount = 0;
+   uint64_t DemandReadCount = 0; // reads the core waited for
+   uint64_t DemandReadCycles = 0;
+   uint64_t RowHitCount = 0;
+   uint64_t RowEmptyCount = 0;
+   uint64_t RowConflictCount = 0;
+   uint64_t MshrWaitCycles = 0;   // cycles reads waited for a free MSHR
+   uint64_t MshrBusyCycles = 0;   // summed MSHR residency, for the mean occupancy
+   uint64_t PrefetchWaitCycles = 0;
+   uint64_t WriteBackStallCycles = 0;
+   uint64_t WriteBackBusyCycles = 0;
+   uint64_t IntervalWidth;
+   vector<TimingInterval> Intervals;
+
+   TimingModel(const TimingConfiguration &InputConfiguration, const vector<CacheModule *> &InputLevels, const vector<string> &LevelNames)
+       : Configuration(InputConfiguration), Levels(InputLevels), IntervalWidth(InputConfiguration.Interval)
+   {
+      for (uint32_t Level = 0; Level < Levels.size(); Level++)
+         HitLatencies.push_back(EstimatedHitLatency(Levels[Level]->SIZE, Levels[Level]->ASSOC));
+      for (const pair<string, uint32_t> &Latency : Configuration.Latencies)
+      {
+         // ConfigurationError has checked that every name is one of the levels
+         vector<string>::const_iterator Name = find(LevelNames.begin(), LevelNames.begin() + Levels.size(), Latency.first);
+         if (Name != LevelNames.begin() + Levels.size())
+            HitLatencies[Name - LevelNames.begin()] = Latency.second;
+      }
+      BlockSize = Levels[0]->BLOCKSIZE;
+      BurstCycles = max(1u, (BlockSize + Configuration.DramBusBytes - 1) / Configuration.DramBusBytes);
+      Banks.resize(Configuration.DramBanks);
+      LevelMisses.resize(Levels.size());
+      ServedCounts.resize(Levels.size() + 1);
+   }
+
+   void BeginAccess()
+   {
+      for (uint32_t Level = 0; Level < Levels.size(); Level++)
+         LevelMisses[Level] = MissCount(Level);
+      Requests.clear();
+   }
+
+   // Times the access just simulated and advances the core past it
+   void EndAccess(CacheAddress Address)
+   {
+      uint64_t Finish = Cycle;
+      uint32_t Served = 0;
+      for (; Served < Levels.size(); Served++)
+      {
+         Finish += HitLatencies[Served];
+         if (MissCount(Served) == LevelMisses[Served])
+            break;
+      }
+      AccessCount += 1;
+      ServedCounts[Served] += 1;
+
+      if ((Served < Levels.size()) && !PrefetchReady.empty())
+      {
+         unordered_map<CacheAddress, uint64_t>::iterator Prefetch = PrefetchReady.find(Address / BlockSize);
+         if (Prefetch != PrefetchReady.end())
+         {
+            if (Prefetch->second > Finish)
+            {
+               PrefetchWaitCycles += Prefetch->second - Finish;
+               Finish = Prefetch->second;
+            }
+            PrefetchReady.erase(Prefetch);
+         }
+      }
+
+      // Memory requests leave after the last lookup; the first demand read of an access that
+      // missed everywhere is the one the core waits for
+      uint64_t Issue = Cycle;
+      for (uint32_t Level = 0; Level < Levels.size(); Level++)
+         Issue += HitLatencies[Level];
+      bool DemandFlag = (Served == Levels.size());
+      uint64_t Accepted = 0;
+      for (const MemoryRequest &Request : Requests)
+      {
+         if (Request.Kind == MemoryWriteBack)
+            Accepted = max(Accepted, WriteBack(Request.BlockAddress, Issue));
+         else
+         {
+            uint64_t Ready = Read(Request.BlockAddress, Issue);
+            if (Request.Kind == MemoryPrefetchRead)
+               PrefetchReady[Request.BlockAddress] = Ready;
+            else if (DemandFlag)
+            {
+               DemandReadCount += 1;
+               DemandReadCycles += Ready - Issue;
+               Finish = Ready;
+               DemandFlag = false;
+            }
+         }
+      }
+      if (Accepted > Finish)
+      {
+         WriteBackStallCycles += Accepted - Finish;
+         Finish = Accepted;
+      }
+      if (PrefetchReady.size() > TimingPrefetchPruneSize)
+         PrunePrefetches(Finish);
+      Cycle = Finish;
+   }
+
+   uint64_t MemoryBytes() const
+   {
+      return (MemoryReadCount + MemoryWriteCount) * BlockSize;
+   }
+
+private:
+   vector<uint64_t> LevelMisses;
+   vector<DramBank> Banks;
+   uint64_t BusReadyCycle = 0;
+   priority_queue<uint64_t, vector<uint64_t>, greater<uint64_t>> Mshrs; // completion cycles
+   deque<uint64_t> WriteBackBuffer; // drain cycles, in order since the bus serializes them
+   unordered_map<CacheAddress, uint64_t> PrefetchReady; // prefetched block -> arrival cycle
+
+   // The top level counts every demand miss, the levels below only the demand reads reaching them
+   uint64_t MissCount(uint32_t Level) const
+   {
+      return Levels[Level]->Statistics.DemandMisses(Level == 0);
+   }
+
+   // One block on its bank and the data bus; returns the cycle the transfer ends
+   uint64_t DramAccess(CacheAddress BlockAddress, uint64_t Issue)
+   {
+      uint64_t Row = (uint64_t)BlockAddress * BlockSize / Configuration.DramRowSize;
+      DramBank &Bank = Banks[Row % Banks.size()];
+      uint64_t ColumnCycle = max(Issue, Bank.ReadyCycle);
+      if (Bank.OpenRow == Row)
+         RowHitCount += 1;
+      else if (Bank.OpenRow == DramRowClosed)
+      {
+         RowEmptyCount += 1;
+         ColumnCycle += Configuration.DramTrcd;
+      }
+      else
+      {
+         RowConflictCount += 1;
+         ColumnCycle += Configuration.DramTrp + Configuration.DramTrcd;
+      }
+      Bank.OpenRow = Row;
+      Bank.ReadyCycle = ColumnCycle + BurstCycles;
+      BusReadyCycle = max(ColumnCycle + Configuration.DramTcas, BusReadyCycle) + BurstCycles;
+      return BusReadyCycle;
+   }
+
+   uint64_t Read(CacheAddress BlockAddress, uint64_t Issue)
+   {
+      while (!Mshrs.empty() && (Mshrs.top() <= Issue))
+         Mshrs.pop();
+      if (Mshrs.size() >= Configuration.MshrCount)
+      {
+         MshrWaitCycles += Mshrs.top() - Issue;
+         Issue = Mshrs.top();
+         Mshrs.pop();
+      }
+      uint64_t Ready = DramAccess(BlockAddress, Issue) + Configuration.DramController;
+      Mshrs.push(Ready);
+      MshrBusyCycles += Ready - Issue;
+      MemoryReadCount += 1;
+      CountTraffic(Ready, false);
+      return Ready;
+   }
+
+   // Returns the cycle the buffer accepted the write-back
+   uint64_t WriteBack(CacheAddress BlockAddress, uint64_t Issue)
+   {
+      while (!WriteBackBuffer.empty() && (WriteBackBuffer.front() <= Issue))
+         WriteBackBuffer.pop_front();
+      uint64_t Accepted = Issue;
+      if (WriteBackBuffer.size() >= Configuration.WriteBackBufferEntries)
+      {
+         Accepted = WriteBackBuffer.front();
+         WriteBackBuffer.pop_front();
+      }
+      uint64_t Drained = DramAccess(BlockAddress, Accepted);
+      WriteBackBuffer.push_back(Drained);
+      WriteBackBusyCycles += Drained - Accepted;
+      MemoryWriteCount += 1;
+      CountTraffic(Drained, true);
+      return Accepted;
+   }
+
+   void CountTraffic(uint64_t TransferCycle, bool WriteFlag)
+   {
+      while (TransferCycle / IntervalWidth >= TimingIntervalsMax)
+      {
+         for (uint32_t Interval = 0; Interval < Intervals.size(); Interval += 2)
+         {
+            TimingInterval Merged = Intervals[Interval];
+            if (Interval + 1 < Intervals.size())
+            {
+               Merged.Reads += Intervals[Interval + 1].Reads;
+               Merged.Writes += Intervals[Interval + 1].Writes;
+            }
+            Intervals[Interval / 2] = Merged;
+         }
+         Intervals.resize((Intervals.size() + 1) / 2);
+         IntervalWidth *= 2;
+      }
+      uint64_t Interval = TransferCycle / IntervalWidth;
+      if (Interval >= Intervals.size())
+         Intervals.resize(Interval + 1);
+      if (WriteFlag)
+         Intervals[Interval].Writes += 1;
+      else
+         Intervals[Interval].Reads += 1;
+   }
+
+   // Prefetches that have arrived cost a later hit nothing, so only those in flight are kept
+   void PrunePrefetches(uint64_t Now)
+   {
+      for (unordered_map<CacheAddress, uint64_t>::iterator Prefetch = PrefetchReady.begin(); Prefetch != PrefetchReady.end();)
+      {
+         if (Prefetch->second <= Now)
+            Prefetch = PrefetchReady.erase(Prefetch);
+         else
+            ++Prefetch;
+      }
+   }
+};
+
+#endif
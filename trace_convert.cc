@@ -0,0 +1,119 @@
+#include "trace_reader.h"
+#include <chrono>
+using namespace std;
+
+// Converts traces between the text and binary formats understood by TraceReader.
+// usage: trace_convert [--delta [--multicore]] <input> <output>   write the binary format (delta
+//                                                  encoded with --delta, keeping core IDs and
+//                                                  instruction fetches with --multicore)
+//        trace_convert --text <input> <output>      write the text format
+//        trace_convert --count <input>              decode only, reporting records and records/s
+// --mmap reads the input through a TraceMapping instead of buffered reads, and --address64 writes
+// binary traces with 64-bit addresses (needed past 32 bits). It is built with SIM_ADDRESS_64, so
+// it reads traces of either address width.
+
+#define ConvertBatchSize 65536
+
+int main(int ArgumentCount, char *ArgumentVariables[])
+{
+   bool DeltaFlag = false;
+   bool MulticoreFlag = false;
+   bool TextFlag = false;
+   bool CountFlag = false;
+   bool MapFlag = false;
+   bool Address64Flag = false;
+   vector<char *> FileNames;
+
+   for (int ArgumentCounter = 1; ArgumentCounter < ArgumentCount; ArgumentCounter++)
+   {
+      if (strcmp(ArgumentVariables[ArgumentCounter], "--delta") == 0)
+         DeltaFlag = true;
+      else if (strcmp(ArgumentVariables[ArgumentCounter], "--multicore") == 0)
+         MulticoreFlag = true;
+      else if (strcmp(ArgumentVariables[ArgumentCounter], "--text") == 0)
+         TextFlag = true;
+      else if (strcmp(ArgumentVariables[ArgumentCounter], "--count") == 0)
+         CountFlag = true;
+      else if (strcmp(ArgumentVariables[ArgumentCounter], "--mmap") == 0)
+         MapFlag = true;
+      else if (strcmp(ArgumentVariables[ArgumentCounter], "--address64") == 0)
+         Address64Flag = true;
+      else
+         FileNames.push_back(ArgumentVariables[ArgumentCounter]);
+   }
+
+   if (FileNames.size() != (CountFlag ? 1u : 2u))
+   {
+      cout << "usage: trace_convert [--mmap] [--address64] [--delta [--multicore] | --text] <input> <output>" << endl
+           << "       trace_convert [--mmap] --count <input>" << endl;
+      exit(EXIT_FAILURE);
+   }
+
+   TraceReader Trace;
+   bool TraceMapped = MapFlag && Trace.Open(TraceMapping::Map(FileNames[0]));
+   if (!TraceMapped && !Trace.Open(FileNames[0]))
+   {
+      cout << "Error: Cannot open " << FileNames[0] << '\n';
+      exit(EXIT_FAILURE);
+   }
+
+   TraceWriter BinaryTrace;
+   FILE *TextFilePointer = NULL;
+   bool OutputOpened = true;
+   if (!CountFlag && TextFlag)
+      OutputOpened = ((TextFilePointer = fopen(FileNames[1], "w")) != (FILE *)NULL);
+   else if (!CountFlag)
+      OutputOpened = BinaryTrace.Open(FileNames[1], DeltaFlag, MulticoreFlag, Address64Flag);
+   if (!OutputOpened)
+   {
+      cout << "Error: Cannot create " << FileNames[1] << '\n';
+      exit(EXIT_FAILURE);
+   }
+
+   vector<TraceRecord> TraceRecords(ConvertBatchSize);
+   size_t RecordCount;
+   uint64_t TotalRecords = 0;
+   uint64_t AddressChecksum = 0;
+   chrono::steady_clock::time_point Start = chrono::steady_clock::now();
+   while ((RecordCount = Trace.ReadRecords(TraceRecords.data(), ConvertBatchSize)) > 0)
+   {
+      for (size_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+      {
+         const TraceRecord &Record = TraceRecords[RecordCounter];
+         char Operation = Record.InstructionFlag ? 'i' : (Record.WriteFlag ? 'w' : 'r');
+         if (CountFlag)
+            AddressChecksum += Record.Address ^ TraceOperation(Record);
+         else if (TextFlag && (Record.Core != 0))
+            fprintf(TextFilePointer, "%u %c " CacheAddressFormat "\n", Record.Core, Operation, Record.Address);
+         else if (TextFlag)
+            fprintf(TextFilePointer, "%c " CacheAddressFormat "\n", Operation, Record.Address);
+         else if (!Address64Flag && ((uint64_t)Record.Address > UINT32_MAX))
+         {
+            cout << "Error: Record " << TotalRecords + RecordCounter << " has an address wider than 32 bits; convert it with --address64" << '\n';
+            exit(EXIT_FAILURE);
+         }
+         else if (!BinaryTrace.Write(Record))
+         {
+            cout << "Error: Record " << TotalRecords + RecordCounter << " has a core ID or instruction fetch; delta encode it with --multicore" << '\n';
+            exit(EXIT_FAILURE);
+         }
+      }
+      TotalRecords += RecordCount;
+   }
+   double Seconds = chrono::duration<double>(chrono::steady_clock::now() - Start).count();
+
+   bool Success = true;
+   if (CountFlag)
+      cout << "records: " << TotalRecords << " checksum: " << hex << AddressChecksum << dec << " records/s: " << (uint64_t)(TotalRecords / Seconds) << endl;
+   else if (TextFlag)
+      Success = (fclose(TextFilePointer) == 0);
+   else
+      Success = BinaryTrace.Close();
+
+   if (!Success)
+   {
+      cout << "Error: Writing " << FileNames[1] << " failed" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   return (0);
+}
@@ -0,0 +1,112 @@
+#include "trace_generator.h"
+using namespace std;
+
+// Writes a synthetic trace (see trace_generator.h) in the binary format, or as text with --text.
+// usage: trace_gen [--pattern=sequential|strided|random|zipf] [--records=N] [--footprint=BYTES]
+//                  [--stride=BYTES] [--write-ratio=F] [--zipf-alpha=A] [--base=ADDRESS]
+//                  [--seed=S] [--text] <output>
+// Numbers may be given in hex (0x...), and sizes may end in K, M or G.
+
+uint64_t ParseSize(const char *Text)
+{
+   char *End;
+   uint64_t Value = strtoull(Text, &End, 0);
+   if ((*End == 'K') || (*End == 'k'))
+      Value <<= 10;
+   else if ((*End == 'M') || (*End == 'm'))
+      Value <<= 20;
+   else if ((*End == 'G') || (*End == 'g'))
+      Value <<= 30;
+   return Value;
+}
+
+int main(int ArgumentCount, char *ArgumentVariables[])
+{
+   TraceGeneratorConfiguration Configuration;
+   uint64_t RecordCount = 1000000;
+   uint64_t Footprint = Configuration.Footprint;
+   bool TextFlag = false;
+   vector<char *> FileNames;
+
+   for (int ArgumentCounter = 1; ArgumentCounter < ArgumentCount; ArgumentCounter++)
+   {
+      const char *Argument = ArgumentVariables[ArgumentCounter];
+      if (strncmp(Argument, "--pattern=", 10) == 0)
+      {
+         Configuration.Pattern = ParseTracePattern(Argument + 10);
+         if (Configuration.Pattern == UINT32_MAX)
+         {
+            cout << "Error: Unknown pattern " << (Argument + 10) << " (sequential, strided, random or zipf)" << '\n';
+            exit(EXIT_FAILURE);
+         }
+      }
+      else if (strncmp(Argument, "--records=", 10) == 0)
+         RecordCount = ParseSize(Argument + 10);
+      else if (strncmp(Argument, "--footprint=", 12) == 0)
+         Footprint = ParseSize(Argument + 12);
+      else if (strncmp(Argument, "--stride=", 9) == 0)
+         Configuration.Stride = (uint32_t)ParseSize(Argument + 9);
+      else if (strncmp(Argument, "--write-ratio=", 14) == 0)
+         Configuration.WriteRatio = atof(Argument + 14);
+      else if (strncmp(Argument, "--zipf-alpha=", 13) == 0)
+         Configuration.ZipfAlpha = atof(Argument + 13);
+      else if (strncmp(Argument, "--base=", 7) == 0)
+         Configuration.Base = (uint32_t)strtoul(Argument + 7, NULL, 0);
+      else if (strncmp(Argument, "--seed=", 7) == 0)
+         Configuration.Seed = strtoull(Argument + 7, NULL, 0);
+      else if (strcmp(Argument, "--text") == 0)
+         TextFlag = true;
+      else if (strncmp(Argument, "--", 2) == 0)
+      {
+         cout << "Error: Unknown option " << Argument << '\n';
+         exit(EXIT_FAILURE);
+      }
+      else
+         FileNames.push_back(ArgumentVariables[ArgumentCounter]);
+   }
+
+   if (FileNames.size() != 1)
+   {
+      cout << "usage: trace_gen [--pattern=sequential|strided|random|zipf] [--records=N] [--footprint=BYTES]" << endl
+           << "                 [--stride=BYTES] [--write-ratio=F] [--zipf-alpha=A] [--base=ADDRESS] [--seed=S] [--text] <output>" << endl;
+      exit(EXIT_FAILURE);
+   }
+   if ((Footprint < 4) || (Configuration.Base + Footprint > ((uint64_t)1 << 32)))
+   {
+      cout << "Error: --footprint needs 4 bytes to the end of the 32-bit address space from --base" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   if ((Configuration.WriteRatio < 0) || (Configuration.WriteRatio > 1))
+   {
+      cout << "Error: --write-ratio needs a fraction in [0, 1]" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   Configuration.Footprint = (uint32_t)min(Footprint, (uint64_t)UINT32_MAX);
+
+   TraceGenerator Generator(Configuration);
+   bool Success;
+   if (TextFlag)
+   {
+      FILE *TextFilePointer = fopen(FileNames[0], "w");
+      if (TextFilePointer == (FILE *)NULL)
+      {
+         cout << "Error: Cannot create " << FileNames[0] << '\n';
+         exit(EXIT_FAILURE);
+      }
+      for (uint64_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+      {
+         TraceRecord Record = Generator.Next();
+         fprintf(TextFilePointer, "%c " CacheAddressFormat "\n", Record.WriteFlag ? 'w' : 'r', Record.Address);
+      }
+      Success = (fclose(TextFilePointer) == 0);
+   }
+   else
+      Success = Generator.WriteTrace(FileNames[0], RecordCount);
+
+   if (!Success)
+   {
+      cout << "Error: Writing " << FileNames[0] << " failed" << '\n';
+      exit(EXIT_FAILURE);
+   }
+   return (0);
+}
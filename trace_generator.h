@@ -0,0 +1,140 @@
+#ifndef TRACE_GENERATOR_H
+#define TRACE_GENERATOR_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "trace_reader.h"
+
+using namespace std;
+
+// Synthetic single-core traces for trace_gen and sim_bench. Addresses are 4-byte aligned and stay
+// within Footprint bytes from Base:
+//   - sequential  consecutive words, wrapping around the footprint
+//   - strided     every Stride bytes, wrapping with a one-word shift so each pass touches new words
+//   - random      uniform words
+//   - zipf        blocks of TraceGeneratorBlockSize bytes drawn with probability ~ 1/rank^Alpha,
+//                 the ranks scattered over the footprint by a seeded shuffle; a uniform word in
+//                 the block is accessed
+// Each record is a write with probability WriteRatio. The same settings and seed always give the
+// same trace.
+
+#define TraceGeneratorBlockSize 64
+#define TraceGeneratorZipfBlocksMax (1u << 22) // Zipf ranks cover at most the first 256 MB
+
+#define PatternSequential 0
+#define PatternStrided 1
+#define PatternRandom 2
+#define PatternZipf 3
+
+static const char *TracePatternNames[] = {"sequential", "strided", "random", "zipf"};
+
+struct TraceGeneratorConfiguration
+{
+   uint32_t Pattern = PatternSequential;
+   uint32_t Footprint = 1 << 24; // bytes
+   uint32_t Stride = 256;        // bytes, strided only
+   double WriteRatio = 0.3;
+   double ZipfAlpha = 1;
+   uint32_t Base = 0x10000000;
+   uint64_t Seed = 1;
+};
+
+// The pattern with this name, or UINT32_MAX
+static inline uint32_t ParseTracePattern(const char *PatternName)
+{
+   for (uint32_t Pattern = 0; Pattern < sizeof(TracePatternNames) / sizeof(TracePatternNames[0]); Pattern++)
+   {
+      if (strcmp(PatternName, TracePatternNames[Pattern]) == 0)
+         return Pattern;
+   }
+   return UINT32_MAX;
+}
+
+class TraceGenerator
+{
+public:
+   TraceGeneratorConfiguration Configuration;
+
+   TraceGenerator(const TraceGeneratorConfiguration &InputConfiguration)
+       : Configuration(InputConfiguration), Random(InputConfiguration.Seed)
+   {
+      WordCount = max(Configuration.Footprint / 4, 1u);
+      StrideWords = max(Configuration.Stride / 4, 1u);
+      if (Configuration.Pattern == PatternZipf)
+      {
+         uint32_t BlockCount = min(max(Configuration.Footprint / TraceGeneratorBlockSize, 1u), TraceGeneratorZipfBlocksMax);
+         ZipfCumulative.resize(BlockCount);
+         double Sum = 0;
+         for (uint32_t Rank = 0; Rank < BlockCount; Rank++)
+            ZipfCumulative[Rank] = (Sum += pow(double(Rank + 1), -Configuration.ZipfAlpha));
+         for (double &Cumulative : ZipfCumulative)
+            Cumulative /= Sum;
+         RankBlocks.resize(BlockCount);
+         for (uint32_t Rank = 0; Rank < BlockCount; Rank++)
+            RankBlocks[Rank] = Rank;
+         shuffle(RankBlocks.begin(), RankBlocks.end(), Random);
+      }
+   }
+
+   TraceRecord Next()
+   {
+      uint32_t Word = 0;
+      switch (Configuration.Pattern)
+      {
+      case PatternSequential:
+         Word = Position;
+         Position = (Position + 1 == WordCount) ? 0 : Position + 1;
+         break;
+      case PatternStrided:
+         Word = Position;
+         Position += StrideWords;
+         if (Position >= WordCount)
+            Position = PassStart = (PassStart + 1) % min(StrideWords, WordCount);
+         break;
+      case PatternRandom:
+         Word = (uint32_t)(Random() % WordCount);
+         break;
+      case PatternZipf:
+      {
+         double Draw = Uniform(Random);
+         uint32_t Rank = (uint32_t)(lower_bound(ZipfCumulative.begin(), ZipfCumulative.end(), Draw) - ZipfCumulative.begin());
+         Word = RankBlocks[min(Rank, (uint32_t)RankBlocks.size() - 1)] * (TraceGeneratorBlockSize / 4) + (uint32_t)(Random() % (TraceGeneratorBlockSize / 4));
+         break;
+      }
+      }
+      TraceRecord Record;
+      Record.Address = Configuration.Base + Word * 4;
+      Record.WriteFlag = Uniform(Random) < Configuration.WriteRatio;
+      Record.InstructionFlag = false;
+      Record.Core = 0;
+      return Record;
+   }
+
+   // Writes RecordCount records to a binary trace; false when the file cannot be written
+   bool WriteTrace(const char *TraceFileName, uint64_t RecordCount)
+   {
+      TraceWriter Trace;
+      if (!Trace.Open(TraceFileName, false))
+         return false;
+      for (uint64_t RecordCounter = 0; RecordCounter < RecordCount; RecordCounter++)
+         Trace.Write(Next());
+      return Trace.Close();
+   }
+
+private:
+   mt19937_64 Random;
+   uniform_real_distribution<double> Uniform{0, 1};
+   uint32_t WordCount;
+   uint32_t StrideWords;
+   uint32_t Position = 0;
+   uint32_t PassStart = 0;
+   vector<double> ZipfCumulative;
+   vector<uint32_t> RankBlocks;
+};
+
+#endif
@@ -0,0 +1,767 @@
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "address_width.h"
+#include "profiler.h"
+
+using namespace std;
+
+// Trace input. TraceReader accepts
+//   - the text format "[<core>] <r|w|i> <hex address>" one record per line, parsed by hand from
+//     large reads; i is an instruction fetch and a missing core ID means core 0
+//   - the binary format written by TraceWriter: TraceBinaryMagic, uint32 version, uint32 flags,
+//     then either 5-byte records [op][address, little endian] or, with TraceDeltaFlag, one
+//     LEB128 varint per record holding (zigzag(address - previous address) << 1) | op, or
+//     << 8 with TraceOperationFlag. The op byte is write | instruction << 1 | core << 2, so plain
+//     single-core traces only ever use its low bit. With TraceAddress64Flag addresses are 64-bit:
+//     9-byte records, or deltas taken and zigzagged over 64 bits.
+//   - either of the above compressed with gzip or zstd, decompressed by a gzip/zstd child process
+// An uncompressed trace can instead be read from a TraceMapping, which is parsed in place and
+// may be shared by any number of readers in the same process.
+// Addresses wider than CacheAddress (see address_width.h) are an error, never truncated.
+
+#define TraceBinaryMagic "CMHTRACE"
+#define TraceBinaryMagicSize 8
+#define TraceBinaryHeaderSize 16
+#define TraceBinaryVersion 1
+#define TraceDeltaFlag 0x1
+#define TraceOperationFlag 0x2
+#define TraceAddress64Flag 0x4
+#define TraceOperationWrite 0x1
+#define TraceOperationInstruction 0x2
+#define TraceOperationCoreShift 2
+#define TraceCoreMax 64
+#define TraceBinaryRecordSize 5
+#define TraceBinaryRecordSize64 9
+#define TraceReadChunkSize (4 << 20)
+#define TraceTextRecordMaxSize 64
+#define TraceTextBlockSize 4096 // bytes ParseTextLines indexes the newlines of at a time
+
+#ifdef SIM_ADDRESS_64
+typedef unsigned __int128 TraceVarint; // a 64-bit zigzag delta above the op byte takes up to 72 bits
+#else
+typedef uint64_t TraceVarint;
+#endif
+#define TraceVarintMaxSize ((MaxAddressBitSize + 8 + 6) / 7) // LEB128 bytes of the longest record: a full-width delta above an 8-bit op
+
+struct TraceRecord
+{
+   CacheAddress Address;
+   uint8_t WriteFlag;
+   uint8_t InstructionFlag; // instruction fetch, always a read
+   uint16_t Core;
+};
+
+static inline uint8_t TraceOperation(const TraceRecord &Record)
+{
+   return (Record.WriteFlag & 1) | (Record.InstructionFlag ? TraceOperationInstruction : 0) | (Record.Core << TraceOperationCoreShift);
+}
+
+static inline void TraceSetOperation(TraceRecord &Record, uint8_t Operation)
+{
+   Record.WriteFlag = Operation & TraceOperationWrite;
+   Record.InstructionFlag = (Operation & TraceOperationInstruction) != 0;
+   Record.Core = Operation >> TraceOperationCoreShift;
+}
+
+static const int8_t TraceHexDigitValue[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+// High bit of each zero byte of Word. Exact, unlike the borrow-based test, so a match after
+// the first one is never spurious.
+static inline uint64_t TraceZeroBytes(uint64_t Word)
+{
+   const uint64_t Low = 0x7f7f7f7f7f7f7f7full;
+   return ~(((Word & Low) + Low) | Word | Low);
+}
+
+// Counts the leading hex digits of the 8 characters in Word (the first character in the low
+// byte) and sets Value to them as a number. Branch-free SWAR: the bytes are classified and
+// converted all at once, and the nibbles are packed pairwise. Address lengths that vary from
+// record to record therefore cost no mispredicted loop exits.
+static inline uint32_t TraceHexDigits(uint64_t Word, uint64_t &Value)
+{
+   const uint64_t Ones = 0x0101010101010101ull;
+   const uint64_t High = 0x8080808080808080ull;
+   uint64_t Low = Word & ~High; // bytes below 0x80, so adding to them never carries into the next byte
+   uint64_t Lower = Low | (0x20 * Ones);
+   uint64_t Digit = (Low + (0x80 - '0') * Ones) & ~(Low + (0x80 - '9' - 1) * Ones) & High;
+   uint64_t Letter = (Lower + (0x80 - 'a') * Ones) & ~(Lower + (0x80 - 'f' - 1) * Ones) & High;
+   uint64_t NotHex = ~((Digit | Letter) & ~Word) & High;
+   uint32_t Count = (NotHex != 0) ? (uint32_t)__builtin_ctzll(NotHex) / 8 : 8;
+
+   // Drop the bytes after the digits; the last digit ends up in the top byte
+   uint64_t Nibbles = (Low & (0x0f * Ones)) + (Letter >> 7) * 9;
+   Nibbles = (Count == 0) ? 0 : Nibbles << (64 - 8 * Count);
+   Nibbles = ((Nibbles & 0x0f000f000f000f00ull) >> 8) | ((Nibbles & 0x000f000f000f000full) << 4);
+   Nibbles = ((Nibbles & 0x00ff000000ff0000ull) >> 16) | ((Nibbles & 0x000000ff000000ffull) << 8);
+   Value = ((Nibbles & 0x0000ffff00000000ull) >> 32) | ((Nibbles & 0x000000000000ffffull) << 16);
+   return Count;
+}
+
+// Stores the offsets of the newlines in the first Size bytes of Text (rounded up to 16), in
+// order, and returns how many there are. A 16-byte chunk of ordinary records holds at most 4
+// newlines. Up to 4 are stored without branching on how many there are, because that count
+// changes from chunk to chunk at random.
+static inline size_t TraceIndexNewLines(const char *Text, size_t Size, uint16_t *LineEnds)
+{
+   size_t LineCount = 0;
+   for (size_t Offset = 0; Offset < Size; Offset += 16)
+   {
+#ifdef __SSE2__
+      uint32_t NewLines = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Text + Offset)), _mm_set1_epi8('\n')));
+#else
+      uint64_t Words[2];
+      memcpy(Words, Text + Offset, 16);
+      uint32_t NewLines = 0;
+      for (uint32_t Word = 0; Word < 2; Word++)
+      {
+         uint64_t Zero = TraceZeroBytes(Words[Word] ^ 0x0a0a0a0a0a0a0a0aull) >> 7;
+         NewLines |= (uint32_t)(((Zero * 0x0102040810204080ull) >> 56) << (8 * Word)); // one bit per byte
+      }
+#endif
+      for (uint32_t Stored = 0; Stored < 4; Stored++)
+      {
+         LineEnds[LineCount] = (uint16_t)(Offset + __builtin_ctz(NewLines | 0x10000));
+         LineCount += (NewLines != 0);
+         NewLines &= NewLines - 1;
+      }
+      for (; NewLines != 0; NewLines &= NewLines - 1)
+         LineEnds[LineCount++] = (uint16_t)(Offset + __builtin_ctz(NewLines));
+   }
+   return LineCount;
+}
+
+// The leading hex digits of the 16 characters at Text, up to 16, as TraceHexDigits does for 8.
+// With SSE2 (any x86-64) a single pass classifies and converts all 16 characters.
+static inline uint32_t TraceHexDigits16(const char *Text, uint64_t &Value)
+{
+#ifdef __SSE2__
+   __m128i Characters = _mm_loadu_si128((const __m128i *)Text);
+   __m128i Lower = _mm_or_si128(Characters, _mm_set1_epi8(0x20));
+   __m128i Digit = _mm_and_si128(_mm_cmpgt_epi8(Characters, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(Characters, _mm_set1_epi8('9' + 1)));
+   __m128i Letter = _mm_and_si128(_mm_cmpgt_epi8(Lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(Lower, _mm_set1_epi8('f' + 1)));
+   uint32_t Count = (uint32_t)__builtin_ctz(~(uint32_t)_mm_movemask_epi8(_mm_or_si128(Digit, Letter)));
+
+   // Nibbles, paired into bytes with the earlier character high, then packed 8 bytes to a word
+   __m128i Nibbles = _mm_and_si128(_mm_add_epi8(Characters, _mm_and_si128(Letter, _mm_set1_epi8(9))), _mm_set1_epi8(0x0f));
+   Nibbles = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(Nibbles, 4), _mm_set1_epi16(0x00f0)), _mm_srli_epi16(Nibbles, 8));
+   uint64_t Packed = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(_mm_packus_epi16(Nibbles, Nibbles)));
+   Value = (Count == 0) ? 0 : Packed >> (4 * (16 - Count));
+   return Count;
+#else
+   uint64_t Word;
+   uint64_t LowValue;
+   memcpy(&Word, Text, 8);
+   uint32_t Count = TraceHexDigits(Word, Value);
+   if (Count < 8)
+      return Count;
+   memcpy(&Word, Text + 8, 8);
+   uint32_t LowCount = TraceHexDigits(Word, LowValue);
+   Value = (Value << (4 * LowCount)) | LowValue;
+   return Count + LowCount;
+#endif
+}
+
+// Read-only mapping of a whole trace file. Mapped sequential, with transparent huge pages
+// requested where the kernel and filesystem support them; both hints are best effort.
+class TraceMapping
+{
+public:
+   const char *Data = NULL;
+   size_t Size = 0;
+
+   TraceMapping(const TraceMapping &) = delete;
+   TraceMapping &operator=(const TraceMapping &) = delete;
+
+   ~TraceMapping()
+   {
+      if (Data != NULL)
+         munmap((void *)Data, Size);
+   }
+
+   // NULL when the file cannot be mapped (missing, empty, or not a regular file)
+   static shared_ptr<const TraceMapping> Map(const char *TraceFileName)
+   {
+      int FileDescriptor = open(TraceFileName, O_RDONLY);
+      if (FileDescriptor < 0)
+         return NULL;
+      struct stat FileStatus;
+      void *Address = MAP_FAILED;
+      if ((fstat(FileDescriptor, &FileStatus) == 0) && S_ISREG(FileStatus.st_mode) && (FileStatus.st_size > 0))
+         Address = mmap(NULL, (size_t)FileStatus.st_size, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+      close(FileDescriptor);
+      if (Address == MAP_FAILED)
+         return NULL;
+
+      madvise(Address, (size_t)FileStatus.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+      madvise(Address, (size_t)FileStatus.st_size, MADV_HUGEPAGE);
+#endif
+      shared_ptr<TraceMapping> Mapping(new TraceMapping());
+      Mapping->Data = (const char *)Address;
+      Mapping->Size = (size_t)FileStatus.st_size;
+      return Mapping;
+   }
+
+   bool Compressed() const
+   {
+      const unsigned char *Magic = (const unsigned char *)Data;
+      return ((Size >= 2) && (Magic[0] == 0x1f) && (Magic[1] == 0x8b)) || ((Size >= 4) && (Magic[0] == 0x28) && (Magic[1] == 0xb5) && (Magic[2] == 0x2f) && (Magic[3] == 0xfd));
+   }
+
+private:
+   TraceMapping() {}
+};
+
+static inline bool TraceSpace(char Character)
+{
+   return (Character == ' ') || (Character == '\n') || (Character == '\r') || (Character == '\t') || (Character == '\v') || (Character == '\f');
+}
+
+class TraceReader
+{
+public:
+   FILE *TraceFilePointer = NULL;
+   bool PipeFlag = false;
+   bool BinaryFlag = false;
+   bool DeltaFlag = false;
+   bool OperationFlag = false;
+   bool Address64Flag = false;
+   bool EndOfFile = false;
+   bool EndOfTrace = false;
+   CacheAddress PreviousAddress = 0;
+   uint64_t RecordsRead = 0;               // records returned or skipped so far
+   uint64_t RecordLimit = (uint64_t)-1;     // ReadRecords stops once RecordsRead reaches it
+
+   vector<char> Buffer;
+   shared_ptr<const TraceMapping> Mapping;
+   const char *BufferData = NULL; // Buffer.data(), or the mapped file
+   size_t BufferStart = 0;
+   size_t BufferEnd = 0;
+   size_t TextGeneralEnd = 0; // ParseText leaves the records before this offset to its general parser
+
+   ~TraceReader()
+   {
+      Close();
+   }
+
+   bool Open(const char *TraceFileName)
+   {
+      unsigned char Magic[4] = {0, 0, 0, 0};
+      FILE *ProbeFilePointer = fopen(TraceFileName, "rb");
+      if (ProbeFilePointer == (FILE *)NULL)
+         return false;
+      size_t MagicSize = fread(Magic, 1, sizeof(Magic), ProbeFilePointer);
+      fclose(ProbeFilePointer);
+
+      const char *Decompressor = NULL;
+      if ((MagicSize >= 2) && (Magic[0] == 0x1f) && (Magic[1] == 0x8b))
+         Decompressor = "gzip -dc -- ";
+      else if ((MagicSize >= 4) && (Magic[0] == 0x28) && (Magic[1] == 0xb5) && (Magic[2] == 0x2f) && (Magic[3] == 0xfd))
+         Decompressor = "zstd -dc -- ";
+
+      if (Decompressor)
+      {
+         TraceFilePointer = popen((Decompressor + ShellQuote(TraceFileName)).c_str(), "r");
+         PipeFlag = true;
+      }
+      else
+         TraceFilePointer = fopen(TraceFileName, "rb");
+      if (TraceFilePointer == (FILE *)NULL)
+         return false;
+
+      Buffer.resize(2 * TraceReadChunkSize);
+      Refill();
+      ReadHeader();
+      return true;
+   }
+
+   // Reads straight out of a mapping that stays shared with its other readers. Compressed
+   // traces cannot be parsed in place and are rejected.
+   bool Open(const shared_ptr<const TraceMapping> &InputMapping)
+   {
+      if ((InputMapping == NULL) || InputMapping->Compressed())
+         return false;
+      Mapping = InputMapping;
+      Rewind();
+      return true;
+   }
+
+   // Restarts a mapped trace from its first record
+   void Rewind()
+   {
+      BufferData = Mapping->Data;
+      BufferStart = 0;
+      BufferEnd = Mapping->Size;
+      EndOfFile = true;
+      EndOfTrace = false;
+      PreviousAddress = 0;
+      RecordsRead = 0;
+      TextGeneralEnd = 0;
+      ReadHeader();
+   }
+
+   void Close()
+   {
+      Mapping = NULL;
+      if (TraceFilePointer == (FILE *)NULL)
+         return;
+      if (PipeFlag)
+         pclose(TraceFilePointer);
+      else
+         fclose(TraceFilePointer);
+      TraceFilePointer = NULL;
+   }
+
+   // Decodes up to MaxRecords records; 0 means the trace is exhausted
+   size_t ReadRecords(TraceRecord *Records, size_t MaxRecords)
+   {
+      ProfileRegion(ProfileTraceDecode);
+      MaxRecords = (size_t)min((uint64_t)MaxRecords, RecordLimit - min(RecordLimit, RecordsRead));
+      size_t RecordCount = 0;
+      while ((RecordCount < MaxRecords) && !EndOfTrace)
+      {
+         bool FinalPass = EndOfFile;
+         RecordCount += BinaryFlag ? ParseBinary(Records + RecordCount, MaxRecords - RecordCount) : ParseText(Records + RecordCount, MaxRecords - RecordCount);
+         if ((RecordCount < MaxRecords) && !EndOfTrace)
+         {
+            // A pass over the final bytes that still came up short leaves at most a partial
+            // record, which ends the trace the same way a failed fscanf did
+            if (FinalPass)
+               EndOfTrace = true;
+            else
+               Refill();
+         }
+      }
+      RecordsRead += RecordCount;
+      if (EndOfTrace && EndOfFile && PipeFlag && (TraceFilePointer != (FILE *)NULL))
+         CloseDecompressor();
+      return RecordCount;
+   }
+
+   // Discards the next Count records; returns how many there were
+   uint64_t SkipRecords(uint64_t Count)
+   {
+      TraceRecord Records[1024];
+      uint64_t Skipped = 0;
+      size_t RecordCount;
+      while ((Skipped < Count) && ((RecordCount = ReadRecords(Records, (size_t)min((uint64_t)1024, Count - Skipped))) > 0))
+         Skipped += RecordCount;
+      return Skipped;
+   }
+
+private:
+   static string ShellQuote(const char *Text)
+   {
+      string Quoted = "'";
+      for (const char *Character = Text; *Character; Character++)
+      {
+         if (*Character == '\'')
+            Quoted += "'\\''";
+         else
+            Quoted += *Character;
+      }
+      return Quoted + "'";
+   }
+
+   // Once the decompressor's output is exhausted: a missing gzip/zstd or a corrupt or truncated
+   // archive only shows in its exit status, and the records read so far are not the whole trace
+   void CloseDecompressor()
+   {
+      int Status = pclose(TraceFilePointer);
+      TraceFilePointer = NULL;
+      if ((Status == -1) || !WIFEXITED(Status) || (WEXITSTATUS(Status) != 0))
+      {
+         cout << "Error: Trace decompression failed; the compressed trace is truncated or corrupt, or gzip/zstd is missing" << '\n';
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   // Consumes the binary header, if there is one, and sets the format flags from it
+   void ReadHeader()
+   {
+      BinaryFlag = false;
+      DeltaFlag = false;
+      OperationFlag = false;
+      Address64Flag = false;
+      if ((BufferEnd - BufferStart >= TraceBinaryHeaderSize) && (memcmp(BufferData + BufferStart, TraceBinaryMagic, TraceBinaryMagicSize) == 0))
+      {
+         uint32_t Version;
+         uint32_t Flags;
+         memcpy(&Version, BufferData + BufferStart + TraceBinaryMagicSize, sizeof(Version));
+         memcpy(&Flags, BufferData + BufferStart + TraceBinaryMagicSize + 4, sizeof(Flags));
+         if (Version != TraceBinaryVersion)
+         {
+            cout << "Error: Unsupported binary trace version " << Version << '\n';
+            exit(EXIT_FAILURE);
+         }
+         if ((Flags & TraceAddress64Flag) && (MaxAddressBitSize < 64))
+         {
+            cout << "Error: The trace has 64-bit addresses; simulate it with sim64 (make sim64)" << '\n';
+            exit(EXIT_FAILURE);
+         }
+         BinaryFlag = true;
+         DeltaFlag = Flags & TraceDeltaFlag;
+         OperationFlag = Flags & TraceOperationFlag;
+         Address64Flag = Flags & TraceAddress64Flag;
+         BufferStart += TraceBinaryHeaderSize;
+      }
+   }
+
+   // Moves the unconsumed tail to the front and reads another chunk; false once nothing new arrived
+   bool Refill()
+   {
+      if (EndOfFile)
+         return false;
+      if (BufferStart > 0)
+      {
+         memmove(Buffer.data(), Buffer.data() + BufferStart, BufferEnd - BufferStart);
+         BufferEnd -= BufferStart;
+         TextGeneralEnd -= min(TextGeneralEnd, BufferStart);
+         BufferStart = 0;
+      }
+      if (Buffer.size() - BufferEnd < TraceReadChunkSize)
+         Buffer.resize(BufferEnd + TraceReadChunkSize);
+      BufferData = Buffer.data();
+
+      size_t ReadSize = fread(Buffer.data() + BufferEnd, 1, Buffer.size() - BufferEnd, TraceFilePointer);
+      BufferEnd += ReadSize;
+      if (ReadSize == 0)
+         EndOfFile = true;
+      return ReadSize > 0;
+   }
+
+   // Parses whole records from the buffer. A record running into the end of the buffer is left
+   // for the next call unless the file is exhausted, in which case a final record without a
+   // trailing newline is still accepted.
+   size_t ParseText(TraceRecord *Records, size_t MaxRecords)
+   {
+      const char *Data = BufferData;
+      size_t RecordCount = 0;
+
+      while (RecordCount < MaxRecords)
+      {
+         if (BufferStart >= TextGeneralEnd)
+         {
+            size_t LineRecordCount = ParseTextLines(Records + RecordCount, MaxRecords - RecordCount);
+            RecordCount += LineRecordCount;
+            if (LineRecordCount > 0)
+               continue;
+         }
+
+         size_t Position = BufferStart;
+         while ((Position < BufferEnd) && TraceSpace(Data[Position]))
+            Position++;
+         BufferStart = Position;
+         if ((Position >= BufferEnd) || (!EndOfFile && (BufferEnd - Position < TraceTextRecordMaxSize)))
+            break;
+
+         // An optional decimal core ID comes first
+         uint32_t Core = 0;
+         if ((Data[Position] >= '0') && (Data[Position] <= '9'))
+         {
+            while ((Position < BufferEnd) && (Data[Position] >= '0') && (Data[Position] <= '9'))
+               Core = 10 * Core + (Data[Position++] - '0');
+            while ((Position < BufferEnd) && TraceSpace(Data[Position]))
+               Position++;
+            if ((Position >= BufferEnd) || (Core >= TraceCoreMax))
+            {
+               cout << "Error: Bad core ID " << Core << " in trace" << '\n';
+               exit(EXIT_FAILURE);
+            }
+         }
+
+         char Operation = Data[Position++];
+         while ((Position < BufferEnd) && TraceSpace(Data[Position]))
+            Position++;
+         if ((Position + 1 < BufferEnd) && (Data[Position] == '0') && ((Data[Position + 1] == 'x') || (Data[Position + 1] == 'X')) && (Position + 2 < BufferEnd) && (TraceHexDigitValue[(uint8_t)Data[Position + 2]] >= 0))
+            Position += 2;
+
+         // 8 digits at a time; the top nibble is checked before each shift, so an address of more
+         // than 16 significant digits is caught rather than wrapped
+         uint64_t Address = 0;
+         size_t DigitStart = Position;
+         bool AddressOverflow = false;
+         uint32_t DigitCount;
+         do
+         {
+            uint64_t Word = 0;
+            if (BufferEnd - Position >= 8)
+               memcpy(&Word, Data + Position, 8);
+            else
+               memcpy(&Word, Data + Position, BufferEnd - Position); // the zero bytes after the end stop the digits
+            uint64_t Value;
+            DigitCount = TraceHexDigits(Word, Value);
+            if ((DigitCount > 0) && ((Address >> (64 - 4 * DigitCount)) != 0))
+               AddressOverflow = true;
+            Address = (Address << (4 * DigitCount)) | Value;
+            Position += DigitCount;
+         } while ((DigitCount == 8) && (Position < BufferEnd));
+
+         if ((Position >= BufferEnd) && !EndOfFile)
+            break; // the record may continue in the next chunk
+         if (Position == DigitStart)
+         {
+            EndOfTrace = true; // not a record, stop like fscanf returning 1
+            break;
+         }
+         if (AddressOverflow || (Address > CacheAddressMax))
+         {
+            cout << "Error: Trace address 0x" << string(Data + DigitStart, Position - DigitStart) << " needs more than " << MaxAddressBitSize << " bits" << ((MaxAddressBitSize < 64) ? "; simulate it with sim64 (make sim64)" : "") << '\n';
+            exit(EXIT_FAILURE);
+         }
+
+         // Flags set without branching on the operation, which is random from record to record
+         if ((Operation != 'r') && (Operation != 'w') && (Operation != 'i'))
+         {
+            cout << "Error: Unknown request type" << Operation;
+            exit(EXIT_FAILURE);
+         }
+         Records[RecordCount].WriteFlag = (Operation == 'w');
+         Records[RecordCount].InstructionFlag = (Operation == 'i');
+         Records[RecordCount].Address = (CacheAddress)Address;
+         Records[RecordCount].Core = (uint16_t)Core;
+         RecordCount++;
+         BufferStart = Position;
+      }
+      return RecordCount;
+   }
+
+   // Fast path of ParseText over whole lines of the usual form "<r|w|i> <hex address>", with an
+   // optional 0x prefix or CRLF ending. The newlines of a block are found first, so every line's
+   // start is known before the previous line is decoded and the lines decode in parallel in the
+   // host pipeline rather than one after the other. At the first line of any other form (core IDs,
+   // extra blanks, errors) it stops, and that line and the rest of the block go to the general
+   // parser.
+   size_t ParseTextLines(TraceRecord *Records, size_t MaxRecords)
+   {
+      if (BufferEnd - BufferStart < 2 * TraceTextRecordMaxSize)
+         return 0;
+      const char *Block = BufferData + BufferStart;
+      size_t BlockSize = min((size_t)TraceTextBlockSize, BufferEnd - BufferStart - TraceTextRecordMaxSize);
+
+      // The index may run past BlockSize, never past the TraceTextRecordMaxSize bytes kept after it
+      uint16_t LineEnds[TraceTextBlockSize + 32];
+      size_t LineCount = TraceIndexNewLines(Block, BlockSize, LineEnds);
+
+      size_t RecordCount = 0;
+      size_t LineStart = 0;
+      for (size_t Line = 0; (Line < LineCount) && (RecordCount < MaxRecords); Line++)
+      {
+         const char *Text = Block + LineStart;
+         char Operation = Text[0];
+         size_t DigitStart = ((Text[2] == '0') && ((Text[3] | 0x20) == 'x')) ? 4 : 2;
+         uint64_t Address;
+         uint32_t DigitCount = TraceHexDigits16(Text + DigitStart, Address);
+         size_t DigitEnd = LineStart + DigitStart + DigitCount;
+         bool LineEndsAfterDigits = (DigitEnd == LineEnds[Line]) || ((DigitEnd + 1 == LineEnds[Line]) && (Block[DigitEnd] == '\r'));
+         if (!((Text[1] == ' ') & ((Operation == 'r') | (Operation == 'w') | (Operation == 'i')) & (DigitCount > 0) & LineEndsAfterDigits & (Address <= CacheAddressMax)))
+         {
+            TextGeneralEnd = BufferStart + LineEnds[LineCount - 1] + 1;
+            break;
+         }
+         Records[RecordCount].WriteFlag = (Operation == 'w');
+         Records[RecordCount].InstructionFlag = (Operation == 'i');
+         Records[RecordCount].Address = (CacheAddress)Address;
+         Records[RecordCount].Core = 0;
+         RecordCount++;
+         LineStart = LineEnds[Line] + 1;
+      }
+      if (LineCount == 0)
+         TextGeneralEnd = BufferStart + BlockSize; // one long line
+      BufferStart += LineStart;
+      return RecordCount;
+   }
+
+   size_t ParseBinary(TraceRecord *Records, size_t MaxRecords)
+   {
+      const uint8_t *Data = (const uint8_t *)BufferData;
+      size_t RecordCount = 0;
+
+      if (!DeltaFlag && (MaxAddressBitSize == 64) && Address64Flag)
+      {
+         while ((RecordCount < MaxRecords) && (BufferEnd - BufferStart >= TraceBinaryRecordSize64))
+         {
+            uint64_t Address;
+            memcpy(&Address, Data + BufferStart + 1, sizeof(Address));
+            TraceSetOperation(Records[RecordCount], Data[BufferStart]);
+            Records[RecordCount].Address = (CacheAddress)Address;
+            RecordCount++;
+            BufferStart += TraceBinaryRecordSize64;
+         }
+         return RecordCount;
+      }
+      if (!DeltaFlag)
+      {
+         while ((RecordCount < MaxRecords) && (BufferEnd - BufferStart >= TraceBinaryRecordSize))
+         {
+            uint32_t Address;
+            memcpy(&Address, Data + BufferStart + 1, sizeof(Address));
+            TraceSetOperation(Records[RecordCount], Data[BufferStart]);
+            Records[RecordCount].Address = Address;
+            RecordCount++;
+            BufferStart += TraceBinaryRecordSize;
+         }
+         return RecordCount;
+      }
+
+      while (RecordCount < MaxRecords)
+      {
+         TraceVarint Value = 0;
+         uint32_t Shift = 0;
+         size_t Position = BufferStart;
+         while ((Position < BufferEnd) && (Data[Position] & 0x80))
+         {
+            Value |= (TraceVarint)(Data[Position++] & 0x7f) << Shift;
+            Shift += 7;
+            if (Position - BufferStart == TraceVarintMaxSize)
+            {
+               cout << "Error: corrupt trace" << '\n';
+               exit(EXIT_FAILURE);
+            }
+         }
+         if (Position >= BufferEnd)
+            break;
+         Value |= (TraceVarint)Data[Position++] << Shift;
+
+         if ((MaxAddressBitSize == 64) && Address64Flag)
+         {
+            CacheAddress ZigZag = (CacheAddress)(Value >> (OperationFlag ? 8 : 1));
+            PreviousAddress += (ZigZag >> 1) ^ ((CacheAddress)0 - (ZigZag & 1));
+         }
+         else
+         {
+            // 32-bit deltas wrap around the 32-bit address space in every build
+            uint32_t ZigZag = (uint32_t)(Value >> (OperationFlag ? 8 : 1));
+            PreviousAddress = (uint32_t)(PreviousAddress + ((ZigZag >> 1) ^ (0u - (ZigZag & 1))));
+         }
+         TraceSetOperation(Records[RecordCount], OperationFlag ? (uint8_t)Value : (Value & 1));
+         Records[RecordCount].Address = PreviousAddress;
+         RecordCount++;
+         BufferStart = Position;
+      }
+      return RecordCount;
+   }
+};
+
+class TraceWriter
+{
+public:
+   FILE *TraceFilePointer = NULL;
+   bool DeltaFlag = false;
+   bool OperationFlag = false;
+   bool Address64Flag = false;
+   uint64_t PreviousAddress = 0;
+   vector<uint8_t> Buffer;
+
+   // InputOperationFlag makes delta records carry the whole op byte (core and instruction flag);
+   // without it they only hold the write bit. InputAddress64Flag writes 64-bit addresses.
+   bool Open(const char *TraceFileName, bool InputDeltaFlag, bool InputOperationFlag = false, bool InputAddress64Flag = false)
+   {
+      TraceFilePointer = fopen(TraceFileName, "wb");
+      if (TraceFilePointer == (FILE *)NULL)
+         return false;
+      DeltaFlag = InputDeltaFlag;
+      OperationFlag = InputDeltaFlag && InputOperationFlag;
+      Address64Flag = InputAddress64Flag;
+
+      uint8_t Header[TraceBinaryHeaderSize];
+      uint32_t Version = TraceBinaryVersion;
+      uint32_t Flags = (DeltaFlag ? TraceDeltaFlag : 0) | (OperationFlag ? TraceOperationFlag : 0) | (Address64Flag ? TraceAddress64Flag : 0);
+      memcpy(Header, TraceBinaryMagic, TraceBinaryMagicSize);
+      memcpy(Header + TraceBinaryMagicSize, &Version, sizeof(Version));
+      memcpy(Header + TraceBinaryMagicSize + 4, &Flags, sizeof(Flags));
+      Buffer.assign(Header, Header + TraceBinaryHeaderSize);
+      return true;
+   }
+
+   // False when the record has a core or instruction flag the delta encoding cannot carry, or
+   // an address wider than 32 bits without Address64Flag
+   bool Write(const TraceRecord &Record)
+   {
+      uint8_t Operation = TraceOperation(Record);
+      uint64_t Address = Record.Address;
+      if (!Address64Flag && (Address > UINT32_MAX))
+         return false;
+      if (DeltaFlag)
+      {
+         if (!OperationFlag && (Operation & ~TraceOperationWrite))
+            return false;
+         uint64_t ZigZag;
+         if (Address64Flag)
+         {
+            int64_t Delta = (int64_t)(Address - PreviousAddress);
+            ZigZag = ((uint64_t)Delta << 1) ^ (uint64_t)(Delta >> 63);
+         }
+         else
+         {
+            int32_t Delta = (int32_t)((uint32_t)Address - (uint32_t)PreviousAddress);
+            ZigZag = ((uint32_t)Delta << 1) ^ (uint32_t)(Delta >> 31);
+         }
+         TraceVarint Value = OperationFlag ? (((TraceVarint)ZigZag << 8) | Operation) : (((TraceVarint)ZigZag << 1) | Operation);
+         while (Value >= 0x80)
+         {
+            Buffer.push_back((uint8_t)(Value | 0x80));
+            Value >>= 7;
+         }
+         Buffer.push_back((uint8_t)Value);
+         PreviousAddress = Address;
+      }
+      else
+      {
+         uint8_t Packed[TraceBinaryRecordSize64];
+         Packed[0] = Operation;
+         if (Address64Flag)
+            memcpy(Packed + 1, &Address, sizeof(Address));
+         else
+         {
+            uint32_t Address32 = (uint32_t)Address;
+            memcpy(Packed + 1, &Address32, sizeof(Address32));
+         }
+         size_t RecordSize = Address64Flag ? TraceBinaryRecordSize64 : TraceBinaryRecordSize;
+         Buffer.insert(Buffer.end(), Packed, Packed + RecordSize);
+      }
+      if (Buffer.size() >= TraceReadChunkSize)
+         Flush();
+      return true;
+   }
+
+   bool Close()
+   {
+      Flush();
+      bool Success = !ferror(TraceFilePointer);
+      return (fclose(TraceFilePointer) == 0) && Success;
+   }
+
+private:
+   void Flush()
+   {
+      fwrite(Buffer.data(), 1, Buffer.size(), TraceFilePointer);
+      Buffer.clear();
+   }
+};
+
+#endif